@@ -139,70 +139,54 @@ bool get_next_alignment_pair_from_fastqs(gzFile fp1, gzFile fp2, char* buffer, s
 }
 
 
+// the records are decompressed and parsed into batches on a reader thread of
+// their own (see for_each_batch_parallel), so the workers never wait on each other for input
+template <typename T>
+static size_t for_each_record_parallel(function<bool(T&)> get_next, function<void(T&)> lambda) {
+    const size_t batch_size = 256;
+    size_t count = 0;
+    function<bool(vector<T>&)> produce = [&get_next, &count, batch_size](vector<T>& batch) {
+        batch.resize(batch_size);
+        size_t n = 0;
+        bool more_data = true;
+        while (n < batch_size && (more_data = get_next(batch[n]))) {
+            ++n;
+        }
+        batch.resize(n);
+        count += n;
+        return more_data;
+    };
+    for_each_batch_parallel(produce, lambda);
+    return count;
+}
+
 size_t fastq_unpaired_for_each_parallel(string& filename, function<void(Alignment&)> lambda) {
     gzFile fp = (filename != "-") ? gzopen(filename.c_str(), "r") : gzdopen(fileno(stdin), "r");
+    gzbuffer(fp, 1 << 20);
     size_t len = 2 << 18; // 256k
-    size_t nLines = 0;
-    int thread_count = get_thread_count();
-    //vector<Alignment> alns; alns.resize(thread_count);
-    vector<char*> bufs; bufs.resize(thread_count);
-    for (auto& buf : bufs) {
-        buf = new char[len];
-    }
-    bool more_data = true;
-#pragma omp parallel shared(fp, more_data, bufs)
-    {
-        int tid = omp_get_thread_num();
-        while (more_data) {
-            Alignment aln;
-            char* buf = bufs[tid];
-#pragma omp critical (fastq_input)
-            if (more_data) {
-                more_data = get_next_alignment_from_fastq(fp, buf, len, aln);
-                nLines++;
-            }
-            if (more_data) {
-                lambda(aln);
-            }
-        }
-    }
-    for (auto& buf : bufs) {
-        delete buf;
-    }
+    char* buf = new char[len];
+    function<bool(Alignment&)> get_next = [&fp, &buf, &len](Alignment& aln) {
+        return get_next_alignment_from_fastq(fp, buf, len, aln);
+    };
+    size_t nLines = for_each_record_parallel(get_next, lambda);
+    delete [] buf;
     gzclose(fp);
     return nLines;
 }
 
 size_t fastq_paired_interleaved_for_each_parallel(string& filename, function<void(Alignment&, Alignment&)> lambda) {
     gzFile fp = (filename != "-") ? gzopen(filename.c_str(), "r") : gzdopen(fileno(stdin), "r");
+    gzbuffer(fp, 1 << 20);
     size_t len = 2 << 18; // 256k
-    size_t nLines = 0;
-    int thread_count = get_thread_count();
-    //vector<Alignment> alns; alns.resize(thread_count);
-    vector<char*> bufs; bufs.resize(thread_count);
-    for (auto& buf : bufs) {
-        buf = new char[len];
-    }
-    bool more_data = true;
-#pragma omp parallel shared(fp, more_data, bufs)
-    {
-        int tid = omp_get_thread_num();
-        while (more_data) {
-            Alignment mate1, mate2;
-            char* buf = bufs[tid];
-#pragma omp critical (fastq_input)
-            if (more_data) {
-                more_data = get_next_interleaved_alignment_pair_from_fastq(fp, buf, len, mate1, mate2);
-                nLines++;
-            }
-            if (more_data) {
-                lambda(mate1, mate2);
-            }
-        }
-    }
-    for (auto& buf : bufs) {
-        delete buf;
-    }
+    char* buf = new char[len];
+    function<bool(pair<Alignment, Alignment>&)> get_next = [&fp, &buf, &len](pair<Alignment, Alignment>& mates) {
+        return get_next_interleaved_alignment_pair_from_fastq(fp, buf, len, mates.first, mates.second);
+    };
+    function<void(pair<Alignment, Alignment>&)> pair_lambda = [&lambda](pair<Alignment, Alignment>& mates) {
+        lambda(mates.first, mates.second);
+    };
+    size_t nLines = for_each_record_parallel(get_next, pair_lambda);
+    delete [] buf;
     gzclose(fp);
     return nLines;
 }
@@ -210,34 +194,18 @@ size_t fastq_paired_interleaved_for_each_parallel(string& filename, function<voi
 size_t fastq_paired_two_files_for_each_parallel(string& file1, string& file2, function<void(Alignment&, Alignment&)> lambda) {
     gzFile fp1 = (file1 != "-") ? gzopen(file1.c_str(), "r") : gzdopen(fileno(stdin), "r");
     gzFile fp2 = (file2 != "-") ? gzopen(file2.c_str(), "r") : gzdopen(fileno(stdin), "r");
+    gzbuffer(fp1, 1 << 20);
+    gzbuffer(fp2, 1 << 20);
     size_t len = 2 << 18; // 256k
-    size_t nLines = 0;
-    int thread_count = get_thread_count();
-    //vector<Alignment> alns; alns.resize(thread_count);
-    vector<char*> bufs; bufs.resize(thread_count);
-    for (auto& buf : bufs) {
-        buf = new char[len];
-    }
-    bool more_data = true;
-#pragma omp parallel shared(fp1, fp2, more_data, bufs)
-    {
-        int tid = omp_get_thread_num();
-        while (more_data) {
-            Alignment mate1, mate2;
-            char* buf = bufs[tid];
-#pragma omp critical (fastq_input)
-            if (more_data) {
-                more_data = get_next_alignment_pair_from_fastqs(fp1, fp2, buf, len, mate1, mate2);
-                nLines++;
-            }
-            if (more_data) {
-                lambda(mate1, mate2);
-            }
-        }
-    }
-    for (auto& buf : bufs) {
-        delete buf;
-    }
+    char* buf = new char[len];
+    function<bool(pair<Alignment, Alignment>&)> get_next = [&fp1, &fp2, &buf, &len](pair<Alignment, Alignment>& mates) {
+        return get_next_alignment_pair_from_fastqs(fp1, fp2, buf, len, mates.first, mates.second);
+    };
+    function<void(pair<Alignment, Alignment>&)> pair_lambda = [&lambda](pair<Alignment, Alignment>& mates) {
+        lambda(mates.first, mates.second);
+    };
+    size_t nLines = for_each_record_parallel(get_next, pair_lambda);
+    delete [] buf;
     gzclose(fp1);
     gzclose(fp2);
     return nLines;
@@ -0,0 +1,169 @@
+#include "compact_graph.hpp"
+#include "stream.hpp"
+
+#include <algorithm>
+
+namespace vg {
+
+using namespace std;
+
+CompactGraph::CompactGraph(VG& graph) {
+    vector<pair<int64_t, pair<uint64_t, uint64_t> > > nodes;
+    vector<pair<int64_t, int64_t> > edges;
+    nodes.reserve(graph.graph.node_size());
+    edges.reserve(graph.graph.edge_size());
+    for (int i = 0; i < graph.graph.node_size(); ++i) {
+        const Node& node = graph.graph.node(i);
+        nodes.push_back(make_pair(node.id(), make_pair(sequence.size(), node.sequence().size())));
+        sequence.append(node.sequence());
+    }
+    for (int i = 0; i < graph.graph.edge_size(); ++i) {
+        const Edge& edge = graph.graph.edge(i);
+        edges.push_back(make_pair(edge.from(), edge.to()));
+    }
+    build(nodes, edges);
+}
+
+CompactGraph::CompactGraph(istream& in) {
+    vector<pair<int64_t, pair<uint64_t, uint64_t> > > nodes;
+    vector<pair<int64_t, int64_t> > edges;
+    function<void(vector<Graph>&)> lambda = [this, &nodes, &edges](vector<Graph>& chunks) {
+        for (auto& g : chunks) {
+            for (int i = 0; i < g.node_size(); ++i) {
+                const Node& node = g.node(i);
+                nodes.push_back(make_pair(node.id(), make_pair(sequence.size(), node.sequence().size())));
+                sequence.append(node.sequence());
+            }
+            for (int i = 0; i < g.edge_size(); ++i) {
+                const Edge& edge = g.edge(i);
+                edges.push_back(make_pair(edge.from(), edge.to()));
+            }
+        }
+    };
+    stream::for_each_batch(in, lambda);
+    build(nodes, edges);
+}
+
+void CompactGraph::build(vector<pair<int64_t, pair<uint64_t, uint64_t> > >& nodes,
+                         vector<pair<int64_t, int64_t> >& edges) {
+
+    // rank the nodes by id, keeping the first of any duplicates as VG does
+    auto by_id = [](const pair<int64_t, pair<uint64_t, uint64_t> >& a,
+                    const pair<int64_t, pair<uint64_t, uint64_t> >& b) {
+        return a.first < b.first;
+    };
+    bool sorted = true;
+    for (size_t i = 1; i < nodes.size() && sorted; ++i) {
+        sorted = nodes[i-1].first < nodes[i].first;
+    }
+    if (!sorted) {
+        stable_sort(nodes.begin(), nodes.end(), by_id);
+        auto same_id = [](const pair<int64_t, pair<uint64_t, uint64_t> >& a,
+                          const pair<int64_t, pair<uint64_t, uint64_t> >& b) {
+            return a.first == b.first;
+        };
+        nodes.erase(unique(nodes.begin(), nodes.end(), same_id), nodes.end());
+    }
+
+    ids.resize(nodes.size());
+    seq_start.resize(nodes.size() + 1);
+    uint64_t length = 0;
+    for (size_t i = 0; i < nodes.size(); ++i) {
+        ids[i] = nodes[i].first;
+        seq_start[i] = length;
+        length += nodes[i].second.second;
+    }
+    seq_start[nodes.size()] = length;
+
+    // sequences arrive in id order for graphs vg has sorted, so we only rebuild the buffer if needed
+    if (!sorted) {
+        string ranked;
+        ranked.reserve(length);
+        for (auto& n : nodes) {
+            ranked.append(sequence, n.second.first, n.second.second);
+        }
+        sequence.swap(ranked);
+    }
+    nodes.clear();
+    nodes.shrink_to_fit();
+
+    // edges as pairs of ranks, sorted by from and then to, which is the successor order
+    // those leaving the graph are only counted, once for each (from, to) as VG would
+    vector<pair<int64_t, int64_t> > ranked_edges;
+    vector<pair<int64_t, int64_t> > outside_edges;
+    ranked_edges.reserve(edges.size());
+    for (auto& e : edges) {
+        int64_t from = rank(e.first);
+        int64_t to = rank(e.second);
+        if (from >= 0 && to >= 0) {
+            ranked_edges.push_back(make_pair(from, to));
+        } else {
+            outside_edges.push_back(e);
+        }
+    }
+    edges.clear();
+    edges.shrink_to_fit();
+    sort(outside_edges.begin(), outside_edges.end());
+    outside_edge_count = unique(outside_edges.begin(), outside_edges.end()) - outside_edges.begin();
+    sort(ranked_edges.begin(), ranked_edges.end());
+    ranked_edges.erase(unique(ranked_edges.begin(), ranked_edges.end()), ranked_edges.end());
+
+    size_t n = ids.size();
+    from_start.assign(n + 1, 0);
+    to_start.assign(n + 1, 0);
+    to_ranks.resize(ranked_edges.size());
+    from_ranks.resize(ranked_edges.size());
+    for (auto& e : ranked_edges) {
+        ++from_start[e.first + 1];
+        ++to_start[e.second + 1];
+    }
+    for (size_t i = 0; i < n; ++i) {
+        from_start[i+1] += from_start[i];
+        to_start[i+1] += to_start[i];
+    }
+    // a counting sort by to, which keeps the predecessors of each node in order
+    vector<uint64_t> next_from(to_start.begin(), to_start.end() - 1);
+    for (size_t i = 0; i < ranked_edges.size(); ++i) {
+        auto& e = ranked_edges[i];
+        to_ranks[i] = e.second;
+        from_ranks[next_from[e.second]++] = e.first;
+    }
+}
+
+int64_t CompactGraph::rank(int64_t id) const {
+    auto i = lower_bound(ids.begin(), ids.end(), id);
+    if (i == ids.end() || *i != id) {
+        return -1;
+    }
+    return i - ids.begin();
+}
+
+void CompactGraph::for_each_successor(int64_t rank, function<void(int64_t)> lambda) const {
+    for (uint64_t i = from_start[rank]; i < from_start[rank+1]; ++i) {
+        lambda(to_ranks[i]);
+    }
+}
+
+void CompactGraph::for_each_predecessor(int64_t rank, function<void(int64_t)> lambda) const {
+    for (uint64_t i = to_start[rank]; i < to_start[rank+1]; ++i) {
+        lambda(from_ranks[i]);
+    }
+}
+
+void CompactGraph::head_nodes(vector<int64_t>& heads) const {
+    for (size_t i = 0; i < ids.size(); ++i) {
+        if (in_degree(i) == 0) {
+            heads.push_back(ids[i]);
+        }
+    }
+}
+
+void CompactGraph::tail_nodes(vector<int64_t>& tails) const {
+    for (size_t i = 0; i < ids.size(); ++i) {
+        if (out_degree(i) == 0) {
+            tails.push_back(ids[i]);
+        }
+    }
+}
+
+}
@@ -0,0 +1,96 @@
+#ifndef COMPACT_GRAPH_H
+#define COMPACT_GRAPH_H
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <functional>
+#include <cstdint>
+#include "vg.pb.h"
+#include "vg.hpp"
+
+namespace vg {
+
+using namespace std;
+
+/*
+
+  An immutable, read-only view of a graph, for tools which walk a graph but
+  never edit it. VG keeps the protobuf Graph plus several hash maps of node
+  and edge pointers, which costs several times the sequence size, while this
+  keeps only flat arrays:
+
+  nodes are ranked by id, the rank being the index into
+    ids         node id of each rank, sorted
+    seq_start   offset of each node's sequence in sequence, with a final entry
+                for the end of the last node
+    sequence    the sequences of all the nodes, concatenated in rank order
+
+  edges are kept twice in compressed sparse row form, by rank
+    from_start  offset in to_ranks of the first successor of each rank (n+1 entries)
+    to_ranks    successor ranks, sorted within each node
+    to_start    offset in from_ranks of the first predecessor of each rank (n+1 entries)
+    from_ranks  predecessor ranks, sorted within each node
+
+  Like VG's own edge indexes, edges are recorded by their from and to ids, so
+  duplicates are stored once. Edges which don't join two nodes of the graph
+  aren't stored, but they are counted in edge_count, as VG counts them. Paths
+  aren't kept.
+
+ */
+
+class CompactGraph {
+
+public:
+
+    CompactGraph(void) : outside_edge_count(0) { }
+    CompactGraph(VG& graph);
+    // reads the graph straight from a .vg stream, without building a VG
+    CompactGraph(istream& in);
+
+    vector<int64_t> ids;
+    vector<uint64_t> seq_start;
+    string sequence;
+    vector<uint64_t> from_start;
+    vector<int64_t> to_ranks;
+    vector<uint64_t> to_start;
+    vector<int64_t> from_ranks;
+    // edges with an end outside the graph
+    int64_t outside_edge_count;
+
+    int64_t node_count(void) const { return ids.size(); }
+    int64_t edge_count(void) const { return to_ranks.size() + outside_edge_count; }
+    int64_t total_length_of_nodes(void) const { return sequence.size(); }
+
+    // the rank of the node with the given id, or -1 if there is none
+    int64_t rank(int64_t id) const;
+    int64_t id(int64_t rank) const { return ids[rank]; }
+    bool has_node(int64_t id) const { return rank(id) >= 0; }
+
+    size_t length(int64_t rank) const { return seq_start[rank+1] - seq_start[rank]; }
+    const char* sequence_data(int64_t rank) const { return sequence.data() + seq_start[rank]; }
+    string node_sequence(int64_t rank) const { return sequence.substr(seq_start[rank], length(rank)); }
+
+    int out_degree(int64_t rank) const { return from_start[rank+1] - from_start[rank]; }
+    int in_degree(int64_t rank) const { return to_start[rank+1] - to_start[rank]; }
+
+    // calls lambda with the rank of each successor or predecessor of the node of the given rank
+    void for_each_successor(int64_t rank, function<void(int64_t)> lambda) const;
+    void for_each_predecessor(int64_t rank, function<void(int64_t)> lambda) const;
+
+    // ids of the nodes without predecessors or successors, in id order
+    void head_nodes(vector<int64_t>& heads) const;
+    void tail_nodes(vector<int64_t>& tails) const;
+
+private:
+
+    // builds the arrays from nodes (id, offset in sequence, length) and edges (from id, to id)
+    // sequence holds the node sequences in the order the nodes were given
+    void build(vector<pair<int64_t, pair<uint64_t, uint64_t> > >& nodes,
+               vector<pair<int64_t, int64_t> >& edges);
+
+};
+
+}
+
+#endif
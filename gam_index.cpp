@@ -0,0 +1,232 @@
+#include "gam_index.hpp"
+#include "stream.hpp"
+
+#include <fstream>
+#include <cstring>
+#include <cstdlib>
+#include <limits>
+#include <zlib.h>
+#include <google/protobuf/io/zero_copy_stream_impl.h>
+#include <google/protobuf/io/gzip_stream.h>
+#include <google/protobuf/io/coded_stream.h>
+
+namespace vg {
+
+using namespace std;
+
+static const char gam_index_magic[8] = { 'v', 'g', 'g', 'a', 'i', '0', '0', '1' };
+
+// reads the next BGZF block, returning false at the end of the input
+static bool read_bgzf_block(istream& in, string& data) {
+    string block;
+    int got = stream::read_bgzf_block(in, block);
+    if (got == 0) return false;
+    if (got == -1) {
+        cerr << "error:[vg::GAMIndex] the GAM is not BGZF framed, "
+             << "only GAMs written by a vg which writes BGZF blocks can be indexed" << endl;
+        exit(1);
+    } else if (got == -2) {
+        cerr << "error:[vg::GAMIndex] the GAM is truncated" << endl;
+        exit(1);
+    }
+    if (!stream::inflate_bgzf_block(block, data)) {
+        cerr << "error:[vg::GAMIndex] could not decompress a block of the GAM" << endl;
+        exit(1);
+    }
+    return true;
+}
+
+void GAMIndex::index_gam(istream& gam) {
+
+    chunks.clear();
+
+    // the decompressed input we haven't consumed yet, which begins with the chunk we're reading
+    string buffer;
+    // buffer position, which is negative if the block began before the buffer, and file offset
+    vector<pair<int64_t, uint64_t> > block_starts;
+    uint64_t file_offset = 0;
+    bool more_input = true;
+    Alignment alignment;
+
+    // how far we've parsed the current chunk, kept while we wait for more blocks
+    // so each alignment is parsed once however many blocks its chunk spans
+    size_t pos = 0;
+    bool have_count = false;
+    uint64_t count = 0;
+    uint64_t parsed = 0;
+    GAMIndexEntry entry;
+
+    while (true) {
+        bool complete = true;
+        if (!have_count) {
+            size_t at = pos;
+            complete = stream::read_varint(buffer, at, count);
+            if (complete) {
+                pos = at;
+                have_count = true;
+                parsed = 0;
+                entry.count = count;
+                entry.min_id = numeric_limits<int64_t>::max();
+                entry.max_id = numeric_limits<int64_t>::min();
+            }
+        }
+        while (complete && parsed < count) {
+            size_t at = pos;
+            uint64_t size;
+            complete = stream::read_varint(buffer, at, size) && at + size <= buffer.size();
+            if (complete) {
+                alignment.ParseFromArray(buffer.data() + at, size);
+                pos = at + size;
+                ++parsed;
+                auto& path = alignment.path();
+                for (int j = 0; j < path.mapping_size(); ++j) {
+                    int64_t id = path.mapping(j).node_id();
+                    entry.min_id = min(entry.min_id, id);
+                    entry.max_id = max(entry.max_id, id);
+                }
+            }
+        }
+
+        if (!complete) {
+            if (!more_input) break;
+            // pull in another block
+            string data;
+            uint64_t offset = file_offset;
+            if (read_bgzf_block(gam, data)) {
+                file_offset = gam.tellg();
+                block_starts.push_back(make_pair(buffer.size(), offset));
+                buffer.append(data);
+            } else {
+                more_input = false;
+            }
+            continue;
+        }
+
+        // the chunk started at the front of the buffer, in the last block starting at or before it
+        while (block_starts.size() > 1 && block_starts[1].first <= 0) {
+            block_starts.erase(block_starts.begin());
+        }
+        auto& start = block_starts.front();
+        entry.virtual_offset = (start.second << 16) | (uint64_t) (-start.first);
+        if (count > 0 && entry.min_id <= entry.max_id) {
+            chunks.push_back(entry);
+        }
+
+        // drop what we've consumed
+        buffer.erase(0, pos);
+        for (auto& b : block_starts) b.first -= pos;
+        pos = 0;
+        have_count = false;
+    }
+
+    if (!buffer.empty()) {
+        cerr << "error:[vg::GAMIndex] the GAM ends in an incomplete chunk" << endl;
+        exit(1);
+    }
+}
+
+void GAMIndex::save(const string& filename) {
+    ofstream out(filename.c_str(), ios::binary);
+    if (!out) {
+        cerr << "error:[vg::GAMIndex] could not open " << filename << " for writing" << endl;
+        exit(1);
+    }
+    uint64_t chunk_count = chunks.size();
+    out.write(gam_index_magic, sizeof(gam_index_magic));
+    out.write((const char*) &chunk_count, sizeof(chunk_count));
+    for (auto& chunk : chunks) {
+        out.write((const char*) &chunk.virtual_offset, sizeof(uint64_t));
+        out.write((const char*) &chunk.min_id, sizeof(int64_t));
+        out.write((const char*) &chunk.max_id, sizeof(int64_t));
+        out.write((const char*) &chunk.count, sizeof(uint64_t));
+    }
+    out.close();
+}
+
+void GAMIndex::load(const string& filename) {
+    ifstream in(filename.c_str(), ios::binary);
+    if (!in) {
+        cerr << "error:[vg::GAMIndex] could not open " << filename << endl;
+        exit(1);
+    }
+    char magic[8];
+    uint64_t chunk_count = 0;
+    in.read(magic, sizeof(magic));
+    in.read((char*) &chunk_count, sizeof(chunk_count));
+    if (!in || memcmp(magic, gam_index_magic, sizeof(magic)) != 0) {
+        cerr << "error:[vg::GAMIndex] " << filename << " is not a GAM index" << endl;
+        exit(1);
+    }
+    chunks.resize(chunk_count);
+    for (auto& chunk : chunks) {
+        in.read((char*) &chunk.virtual_offset, sizeof(uint64_t));
+        in.read((char*) &chunk.min_id, sizeof(int64_t));
+        in.read((char*) &chunk.max_id, sizeof(int64_t));
+        in.read((char*) &chunk.count, sizeof(uint64_t));
+    }
+    if (!in) {
+        cerr << "error:[vg::GAMIndex] " << filename << " is truncated" << endl;
+        exit(1);
+    }
+}
+
+void GAMIndex::for_alignment_in_range(istream& gam,
+                                      int64_t from_id,
+                                      int64_t to_id,
+                                      function<void(Alignment&)> lambda) {
+    vector<pair<int64_t, int64_t> > ranges;
+    ranges.push_back(make_pair(from_id, to_id));
+    for_alignment_in_ranges(gam, ranges, lambda);
+}
+
+void GAMIndex::for_alignment_in_ranges(istream& gam,
+                                       const vector<pair<int64_t, int64_t> >& ranges,
+                                       function<void(Alignment&)> lambda) {
+
+    auto in_ranges = [&ranges](int64_t first, int64_t last) {
+        for (auto& r : ranges) {
+            if (first <= r.second && last >= r.first) return true;
+        }
+        return false;
+    };
+
+    for (auto& chunk : chunks) {
+        if (!in_ranges(chunk.min_id, chunk.max_id)) continue;
+
+        gam.clear();
+        gam.seekg(chunk.virtual_offset >> 16);
+        ::google::protobuf::io::IstreamInputStream raw_in(&gam);
+        ::google::protobuf::io::GzipInputStream gzip_in(&raw_in);
+        ::google::protobuf::io::CodedInputStream* coded_in =
+              new ::google::protobuf::io::CodedInputStream(&gzip_in);
+        // step to the chunk within its block
+        coded_in->Skip(chunk.virtual_offset & 0xffff);
+
+        uint64_t count = 0;
+        coded_in->ReadVarint64(&count);
+        string s;
+        for (uint64_t i = 0; i < count; ++i) {
+            uint32_t msgSize = 0;
+            // the messages are prefixed by their size
+            delete coded_in;
+            coded_in = new ::google::protobuf::io::CodedInputStream(&gzip_in);
+            coded_in->ReadVarint32(&msgSize);
+            if ((msgSize > 0) &&
+                (coded_in->ReadString(&s, msgSize))) {
+                Alignment alignment;
+                alignment.ParseFromString(s);
+                auto& path = alignment.path();
+                for (int j = 0; j < path.mapping_size(); ++j) {
+                    int64_t id = path.mapping(j).node_id();
+                    if (in_ranges(id, id)) {
+                        lambda(alignment);
+                        break;
+                    }
+                }
+            }
+        }
+        delete coded_in;
+    }
+}
+
+}
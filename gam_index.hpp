@@ -0,0 +1,72 @@
+#ifndef GAM_INDEX_H
+#define GAM_INDEX_H
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <functional>
+#include <cstdint>
+#include "vg.pb.h"
+
+namespace vg {
+
+using namespace std;
+
+/*
+
+  A sidecar index for GAM files, written next to the GAM as <file>.gai.
+
+  GAM is a series of chunks of alignments, and vg writes each chunk into
+  its own BGZF blocks (see stream::write). For each chunk we record its
+  virtual offset, (offset of the block in the file << 16) | offset of the
+  chunk in the block, and the smallest and largest node id its alignments
+  touch. Alignments touching a node range can then be read by seeking to
+  the chunks that overlap it, rather than reading the whole file.
+
+  Chunks written by vg's threads are small and local in the graph when the
+  input is sorted, but any chunk may cover a wide id range, so queries stay
+  correct on unsorted input, they just read more.
+
+  file layout, native byte order:
+  --------------------------------------------------------------
+  header  magic[8] "vggai001", chunk_count [uint64_t]
+  chunks  { virtual_offset [uint64_t], min_id, max_id [int64_t], count [uint64_t] }[chunk_count]
+
+ */
+
+struct GAMIndexEntry {
+    uint64_t virtual_offset;
+    int64_t min_id;
+    int64_t max_id;
+    uint64_t count;
+};
+
+class GAMIndex {
+
+public:
+
+    vector<GAMIndexEntry> chunks;
+
+    // scan a GAM, recording each chunk
+    // the GAM must be BGZF framed, as vg has written it since it began doing so
+    void index_gam(istream& gam);
+
+    void save(const string& filename);
+    void load(const string& filename);
+
+    // calls lambda on every alignment in the GAM that touches a node in [from_id, to_id]
+    // seeking only to the chunks which may contain such alignments
+    void for_alignment_in_range(istream& gam,
+                                int64_t from_id,
+                                int64_t to_id,
+                                function<void(Alignment&)> lambda);
+    // as above for several ranges, each alignment is seen once even if it touches many
+    void for_alignment_in_ranges(istream& gam,
+                                 const vector<pair<int64_t, int64_t> >& ranges,
+                                 function<void(Alignment&)> lambda);
+
+};
+
+}
+
+#endif
@@ -20,6 +20,7 @@ GSSWAligner::GSSWAligner(
     mismatch = _mismatch;
     gap_open = _gap_open;
     gap_extension = _gap_extension;
+    filled = false;
 
     // these are used when setting up the nodes
     // they can be cleaned up via destroy_alignable_graph()
@@ -50,6 +51,13 @@ void GSSWAligner::align(Alignment& alignment) {
 
     const string& sequence = alignment.sequence();
 
+    // drop the node alignments left by any previous fill
+    if (filled) {
+        gssw_graph_clear(graph);
+        graph->max_node = NULL;
+    }
+    filled = true;
+
     gssw_graph_fill(graph, sequence.c_str(),
                     nt_table, score_matrix,
                     gap_open, gap_extension, 15, 2);
@@ -34,6 +34,7 @@ public:
                     set<gssw_node*>& temporary_marks);
 
     // alignment functions
+    // the graph and scoring tables are kept, so this can be called repeatedly
     void align(Alignment& alignment);
     void gssw_mapping_to_alignment(gssw_graph_mapping* gm, Alignment& alignment);
     string graph_cigar(gssw_graph_mapping* gm);
@@ -47,6 +48,8 @@ public:
     int32_t mismatch;
     int32_t gap_open;
     int32_t gap_extension;
+    // set once the graph holds the results of a fill
+    bool filled;
 
 };
 
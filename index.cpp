@@ -1,4 +1,5 @@
 #include "index.hpp"
+#include <cstdio>
 
 namespace vg {
 
@@ -10,6 +11,8 @@ Index::Index(void) {
     end_sep = '\xff';
     write_options = rocksdb::WriteOptions();
     mem_env = false;
+    legacy_layout = false;
+    packed_kmers = false;
     block_cache_size = 1024 * 1024 * 1024; // 1GB
 
     threads = 1;
@@ -70,23 +73,196 @@ rocksdb::Options Index::GetOptions(void) {
     return options;
 }
 
+// the prefix of a kmer key is everything up to the separator after the kmer,
+// +k+kmer+ or +K+length packed+, so that kmers of different lengths have distinct prefixes
+// zero if the key has no complete kmer
+static size_t kmer_prefix_length(const rocksdb::Slice& key, char sep) {
+    if (key.size() < 4) return 0;
+    if (key[1] == 'K') {
+        // packed kmers may contain the separator, but their length is known
+        size_t length = 4 + ((uint8_t) key[3] + 3) / 4 + 1;
+        return length <= key.size() ? length : 0;
+    }
+    if (key[1] != 'k') return 0;
+    const char* end = (const char*) memchr(key.data() + 3, sep, key.size() - 3);
+    return end ? end - key.data() + 1 : 0;
+}
+
+class KmerPrefixTransform : public rocksdb::SliceTransform {
+public:
+    KmerPrefixTransform(char sep) : sep(sep) { }
+    const char* Name(void) const { return "vg.KmerPrefixTransform"; }
+    rocksdb::Slice Transform(const rocksdb::Slice& key) const {
+        return rocksdb::Slice(key.data(), prefix_length(key));
+    }
+    bool InDomain(const rocksdb::Slice& key) const {
+        return prefix_length(key) > 0;
+    }
+    bool InRange(const rocksdb::Slice& dst) const {
+        return false;
+    }
+private:
+    char sep;
+    size_t prefix_length(const rocksdb::Slice& key) const {
+        return kmer_prefix_length(key, sep);
+    }
+};
+
+// the column family holding each key namespace
+static const vector<pair<char, string> > namespace_family_names = {
+    { 'a', "alignments" },
+    { 'g', "graph" },
+    { 'k', "kmers" },
+    { 'm', "metadata" },
+    { 'p', "paths" },
+    { 's', "mappings" }
+};
+
+rocksdb::ColumnFamilyOptions Index::GetColumnFamilyOptions(char key_type) {
+
+    rocksdb::ColumnFamilyOptions options(GetOptions());
+
+    rocksdb::BlockBasedTableOptions topt;
+    topt.block_cache = block_cache;
+
+    switch (key_type) {
+    case 'g':
+        // nodes and edges are small and read at random while mapping
+        // so keep blocks small and their index and filter blocks cached
+        topt.block_size = 4 * 1024;
+        topt.cache_index_and_filter_blocks = true;
+        topt.filter_policy.reset(rocksdb::NewBloomFilterPolicy(10, false));
+        break;
+    case 'k':
+        // every read is a scan of one kmer's keys, so the filters are built on the kmer prefix
+        // most kmers of reads with errors aren't in the graph, and those never reach a data block
+        topt.block_size = 16 * 1024;
+        topt.whole_key_filtering = false;
+        topt.filter_policy.reset(rocksdb::NewBloomFilterPolicy(10, false));
+        topt.index_type = rocksdb::BlockBasedTableOptions::kHashSearch;
+        options.prefix_extractor.reset(new KmerPrefixTransform(start_sep));
+        break;
+    case 'm':
+        topt.filter_policy.reset(rocksdb::NewBloomFilterPolicy(16, false));
+        break;
+    case 'p':
+        // paths are scanned in order
+        topt.block_size = 16 * 1024;
+        topt.whole_key_filtering = false;
+        break;
+    case 'a':
+    case 's':
+        // large and rarely read, trade time for space
+        topt.block_size = 64 * 1024;
+        topt.whole_key_filtering = false;
+        options.compression = rocksdb::kZlibCompression;
+        for (auto& c : options.compression_per_level) {
+            c = rocksdb::kZlibCompression;
+        }
+        break;
+    default:
+        break;
+    }
+
+    options.table_factory.reset(NewBlockBasedTableFactory(topt));
+    return options;
+}
+
 void Index::open(const std::string& dir, bool read_only) {
 
     name = dir;
     db_options = GetOptions();
+    db_options.create_missing_column_families = true;
+    block_cache = rocksdb::NewLRUCache(block_cache_size);
+
+    // an index which exists with only the default column family was written
+    // before we split the namespaces, and keeps them all there
+    vector<string> existing;
+    rocksdb::Status s = rocksdb::DB::ListColumnFamilies(db_options, name, &existing);
+    legacy_layout = s.ok() && existing.size() == 1;
+
+    vector<rocksdb::ColumnFamilyDescriptor> descriptors;
+    descriptors.push_back(rocksdb::ColumnFamilyDescriptor(rocksdb::kDefaultColumnFamilyName, db_options));
+    vector<char> key_types;
+    if (!legacy_layout) {
+        for (auto& ns : namespace_family_names) {
+            // we can't create column families in a read only index
+            if (read_only && s.ok()
+                && find(existing.begin(), existing.end(), ns.second) == existing.end()) {
+                continue;
+            }
+            descriptors.push_back(rocksdb::ColumnFamilyDescriptor(ns.second, GetColumnFamilyOptions(ns.first)));
+            key_types.push_back(ns.first);
+        }
+    }
 
-    rocksdb::Status s;
+    column_families.clear();
     if (read_only) {
-        //s = rocksdb::DB::Open(db_options, name, &db);
-        s = rocksdb::DB::OpenForReadOnly(db_options, name, &db);
+        s = rocksdb::DB::OpenForReadOnly(db_options, name, descriptors, &column_families, &db);
     } else {
-        s = rocksdb::DB::Open(db_options, name, &db);
+        s = rocksdb::DB::Open(db_options, name, descriptors, &column_families, &db);
     }
     if (!s.ok()) {
         throw indexOpenException();
     }
+
+    // namespaces without their own column family fall back to the default
+    namespace_families.clear();
+    for (auto& ns : namespace_family_names) {
+        namespace_families[ns.first] = column_families.front();
+    }
+    for (size_t i = 0; i < key_types.size(); ++i) {
+        namespace_families[key_types[i]] = column_families[i+1];
+    }
+    // packed kmers live with the others
+    namespace_families['K'] = namespace_families['k'];
     is_open = true;
 
+    // paths are named in the metadata, but we look them up too often to read it each time
+    path_ids = paths_by_id();
+    path_names.clear();
+    for (auto& p : path_ids) {
+        path_names[p.second] = p.first;
+    }
+
+    // the kmers of an index are either all packed or all not
+    string data;
+    if (get_metadata("packed_kmers", data).ok()) {
+        packed_kmers = true;
+    } else if (packed_kmers && !stored_kmer_sizes().empty()) {
+        cerr << "error:[vg::Index] " << name << " already holds unpacked kmers, "
+             << "they can't be mixed with packed kmers" << endl;
+        exit(1);
+    }
+
+}
+
+rocksdb::ColumnFamilyHandle* Index::family_for_type(char key_type) {
+    auto f = namespace_families.find(key_type);
+    if (f == namespace_families.end()) {
+        cerr << "error:[vg::Index] no column family for keys of type " << key_type << endl;
+        exit(1);
+    }
+    return f->second;
+}
+
+rocksdb::ColumnFamilyHandle* Index::family_for_key(const string& key) {
+    if (key.size() < 2) {
+        cerr << "error:[vg::Index] key has no namespace" << endl;
+        exit(1);
+    }
+    return family_for_type(key[1]);
+}
+
+vector<rocksdb::ColumnFamilyHandle*> Index::families_in_key_order(void) {
+    vector<rocksdb::ColumnFamilyHandle*> families;
+    for (auto& ns : namespace_family_names) {
+        auto family = family_for_type(ns.first);
+        if (find(families.begin(), families.end(), family) == families.end()) {
+            families.push_back(family);
+        }
+    }
+    return families;
 }
 
 void Index::open_read_only(string& dir) {
@@ -113,16 +289,28 @@ Index::~Index(void) {
 
 void Index::close(void) {
     flush();
+    // the handles must go before the db
+    for (auto family : column_families) {
+        delete family;
+    }
+    column_families.clear();
+    namespace_families.clear();
+    path_ids.clear();
+    path_names.clear();
     delete db;
     is_open = false;
 }
 
 void Index::flush(void) {
-    db->Flush(rocksdb::FlushOptions());
+    for (auto family : column_families) {
+        db->Flush(rocksdb::FlushOptions(), family);
+    }
 }
 
 void Index::compact(void) {
-    db->CompactRange(NULL, NULL);
+    for (auto family : column_families) {
+        db->CompactRange(rocksdb::CompactRangeOptions(), family, NULL, NULL);
+    }
 }
 
 // todo: replace with union / struct
@@ -176,7 +364,51 @@ const string Index::key_for_edge_to_from(int64_t to, int64_t from) {
     return key;
 }
 
+// 2 bits per base, the first base in the high bits of the first byte so packed kmers
+// of the same length sort as their sequences do
+static bool pack_kmer(const string& kmer, string& packed) {
+    if (kmer.size() > UCHAR_MAX) return false;
+    packed.assign((kmer.size() + 3) / 4, '\0');
+    for (size_t i = 0; i < kmer.size(); ++i) {
+        uint8_t code;
+        switch (kmer[i]) {
+        case 'A': code = 0; break;
+        case 'C': code = 1; break;
+        case 'G': code = 2; break;
+        case 'T': code = 3; break;
+        default: return false;
+        }
+        packed[i/4] |= code << (6 - 2*(i%4));
+    }
+    return true;
+}
+
+static string unpack_kmer(const char* packed, size_t length) {
+    static const char bases[4] = { 'A', 'C', 'G', 'T' };
+    string kmer(length, 'N');
+    for (size_t i = 0; i < length; ++i) {
+        kmer[i] = bases[((uint8_t) packed[i/4] >> (6 - 2*(i%4))) & 3];
+    }
+    return kmer;
+}
+
 const string Index::key_for_kmer(const string& kmer, int64_t id) {
+    if (packed_kmers) {
+        string packed;
+        if (!pack_kmer(kmer, packed)) {
+            cerr << "error:[vg::Index] cannot pack kmer " << kmer << ", "
+                 << "packed kmers must be A, C, G and T and at most " << UCHAR_MAX << "bp" << endl;
+            exit(1);
+        }
+        id = htobe64(id);
+        string key(4, start_sep);
+        key[1] = 'K';
+        key[3] = (char) kmer.size();
+        key.append(packed);
+        key.push_back(start_sep);
+        key.append((char*) &id, sizeof(int64_t));
+        return key;
+    }
     id = htobe64(id);
     string key;
     key.resize(4*sizeof(char) + kmer.size() + sizeof(int64_t));
@@ -246,6 +478,18 @@ const string Index::key_for_path_position(int64_t path_id, int64_t path_pos, int
 }
 
 const string Index::key_prefix_for_kmer(const string& kmer) {
+    if (packed_kmers) {
+        // +K+length packed
+        string key(4, start_sep);
+        key[1] = 'K';
+        string packed;
+        if (pack_kmer(kmer, packed)) {
+            key[3] = (char) kmer.size();
+            key.append(packed);
+        }
+        // otherwise the kmer can't be in the index, and the length 0 prefix matches nothing
+        return key;
+    }
     string key;
     key.resize(3*sizeof(char) + kmer.size());
     char* k = (char*) key.c_str();
@@ -332,17 +576,18 @@ const string Index::key_prefix_for_edges_to_node(int64_t to) {
     return key.substr(0, key.size()-sizeof(int64_t));
 }
 
-char Index::graph_key_type(string& key) {
-    return key.c_str()[4*sizeof(char) + sizeof(int64_t)];
+char Index::graph_key_type(const rocksdb::Slice& key) {
+    return key.data()[4*sizeof(char) + sizeof(int64_t)];
 }
 
-string Index::entry_to_string(const string& key, const string& value) {
+string Index::entry_to_string(const rocksdb::Slice& key, const rocksdb::Slice& value) {
     char type = key[1];
     switch (type) {
     case 'g':
         return graph_entry_to_string(key, value);
         break;
     case 'k':
+    case 'K':
         return kmer_entry_to_string(key, value);
         break;
     case 'p':
@@ -362,22 +607,22 @@ string Index::entry_to_string(const string& key, const string& value) {
     }
 }
 
-void Index::parse_node(const string& key, const string& value, int64_t& id, Node& node) {
-    const char* k = key.c_str();
+void Index::parse_node(const rocksdb::Slice& key, const rocksdb::Slice& value, int64_t& id, Node& node) {
+    const char* k = key.data();
     memcpy(&id, (k + 3*sizeof(char)), sizeof(int64_t));
     id = be64toh(id);
-    node.ParseFromString(value);
+    node.ParseFromArray(value.data(), value.size());
 }
 
-void Index::parse_edge(const string& key, const string& value, char& type, int64_t& id1, int64_t& id2, Edge& edge) {
-    const char* k = key.c_str();
+void Index::parse_edge(const rocksdb::Slice& key, const rocksdb::Slice& value, char& type, int64_t& id1, int64_t& id2, Edge& edge) {
+    const char* k = key.data();
     memcpy(&id1, (k + 3*sizeof(char)), sizeof(int64_t));
     memcpy(&id2, (k + 3*sizeof(char)+sizeof(int64_t)+3*sizeof(char)), sizeof(int64_t));
     id1 = be64toh(id1);
     id2 = be64toh(id2);
     type = k[3*sizeof(char)+sizeof(int64_t)+1*sizeof(char)];
     if (type == 'f') {
-        //edge.ParseFromString(value);
+        //edge.ParseFromArray(value.data(), value.size());
         edge.set_from(id1);
         edge.set_to(id2);
     } else {
@@ -390,10 +635,10 @@ void Index::parse_edge(const string& key, const string& value, char& type, int64
     }
 }
 
-string Index::graph_entry_to_string(const string& key, const string& value) {
+string Index::graph_entry_to_string(const rocksdb::Slice& key, const rocksdb::Slice& value) {
     // do we have a node or edge?
     stringstream s;
-    switch (graph_key_type((string&)key)) {
+    switch (graph_key_type(key)) {
     case 'n': {
         // it's a node
         int64_t id;
@@ -429,15 +674,21 @@ string Index::graph_entry_to_string(const string& key, const string& value) {
     return s.str();
 }
 
-void Index::parse_kmer(const string& key, const string& value, string& kmer, int64_t& id, int32_t& pos) {
-    const char* k = key.c_str();
-    kmer = string(k+3*sizeof(char));
-    memcpy(&id, k+4*sizeof(char)+kmer.size(), sizeof(int64_t));
+void Index::parse_kmer(const rocksdb::Slice& key, const rocksdb::Slice& value, string& kmer, int64_t& id, int32_t& pos) {
+    const char* k = key.data();
+    if (k[1] == 'K') {
+        size_t length = (uint8_t) k[3];
+        kmer = unpack_kmer(k+4*sizeof(char), length);
+        memcpy(&id, k+5*sizeof(char)+(length+3)/4, sizeof(int64_t));
+    } else {
+        kmer = string(k+3*sizeof(char));
+        memcpy(&id, k+4*sizeof(char)+kmer.size(), sizeof(int64_t));
+    }
     id = be64toh(id);
-    memcpy(&pos, (char*)value.c_str(), sizeof(int32_t));
+    memcpy(&pos, value.data(), sizeof(int32_t));
 }
 
-string Index::kmer_entry_to_string(const string& key, const string& value) {
+string Index::kmer_entry_to_string(const rocksdb::Slice& key, const rocksdb::Slice& value) {
     stringstream s;
     int64_t id;
     int32_t pos;
@@ -447,49 +698,49 @@ string Index::kmer_entry_to_string(const string& key, const string& value) {
     return s.str();
 }
 
-void Index::parse_node_path(const string& key, const string& value,
+void Index::parse_node_path(const rocksdb::Slice& key, const rocksdb::Slice& value,
                             int64_t& node_id, int64_t& path_id, int64_t& path_pos, Mapping& mapping) {
-    const char* k = key.c_str();
+    const char* k = key.data();
     memcpy(&node_id, (k + 3*sizeof(char)), sizeof(int64_t));
     memcpy(&path_id, (k + 6*sizeof(char)+sizeof(int64_t)), sizeof(int64_t));
     memcpy(&path_pos, (k + 7*sizeof(char)+2*sizeof(int64_t)), sizeof(int64_t));
     node_id = be64toh(node_id);
     path_id = be64toh(path_id);
     path_pos = be64toh(path_pos);
-    mapping.ParseFromString(value);
+    mapping.ParseFromArray(value.data(), value.size());
 }
 
-void Index::parse_path_position(const string& key, const string& value,
+void Index::parse_path_position(const rocksdb::Slice& key, const rocksdb::Slice& value,
                                 int64_t& path_id, int64_t& path_pos, int64_t& node_id, Mapping& mapping) {
-    const char* k = key.c_str();
+    const char* k = key.data();
     memcpy(&path_id, (k + 3*sizeof(char)), sizeof(int64_t));
     memcpy(&path_pos, (k + 4*sizeof(char)+sizeof(int64_t)), sizeof(int64_t));
     memcpy(&node_id, (k + 5*sizeof(char)+2*sizeof(int64_t)), sizeof(int64_t));
     node_id = be64toh(node_id);
     path_id = be64toh(path_id);
     path_pos = be64toh(path_pos);
-    mapping.ParseFromString(value);
+    mapping.ParseFromArray(value.data(), value.size());
 }
 
-void Index::parse_mapping(const string& key, const string& value, int64_t& node_id, string& hash, Mapping& mapping) {
-    const char* k = key.c_str();
+void Index::parse_mapping(const rocksdb::Slice& key, const rocksdb::Slice& value, int64_t& node_id, string& hash, Mapping& mapping) {
+    const char* k = key.data();
     memcpy(&node_id, (k + 3*sizeof(char)), sizeof(int64_t));
     hash.resize(8);
     memcpy((char*)hash.c_str(), (k + 4*sizeof(char) + sizeof(int64_t)), 8*sizeof(char));
     node_id = be64toh(node_id);
-    mapping.ParseFromString(value);
+    mapping.ParseFromArray(value.data(), value.size());
 }
 
-void Index::parse_alignment(const string& key, const string& value, int64_t& node_id, string& hash, Alignment& alignment) {
-    const char* k = key.c_str();
+void Index::parse_alignment(const rocksdb::Slice& key, const rocksdb::Slice& value, int64_t& node_id, string& hash, Alignment& alignment) {
+    const char* k = key.data();
     memcpy(&node_id, (k + 3*sizeof(char)), sizeof(int64_t));
     hash.resize(8);
     memcpy((char*)hash.c_str(), (k + 4*sizeof(char) + sizeof(int64_t)), 8*sizeof(char));
     node_id = be64toh(node_id);
-    alignment.ParseFromString(value);
+    alignment.ParseFromArray(value.data(), value.size());
 }
 
-string Index::node_path_to_string(const string& key, const string& value) {
+string Index::node_path_to_string(const rocksdb::Slice& key, const rocksdb::Slice& value) {
     Mapping mapping;
     int64_t node_id, path_id, path_pos;
     parse_node_path(key, value, node_id, path_id, path_pos, mapping);
@@ -500,7 +751,7 @@ string Index::node_path_to_string(const string& key, const string& value) {
     return s.str();
 }
 
-string Index::path_position_to_string(const string& key, const string& value) {
+string Index::path_position_to_string(const rocksdb::Slice& key, const rocksdb::Slice& value) {
     Mapping mapping;
     int64_t node_id, path_id, path_pos;
     parse_path_position(key, value, path_id, path_pos, node_id, mapping);
@@ -511,15 +762,15 @@ string Index::path_position_to_string(const string& key, const string& value) {
     return s.str();
 }
 
-string Index::metadata_entry_to_string(const string& key, const string& value) {
+string Index::metadata_entry_to_string(const rocksdb::Slice& key, const rocksdb::Slice& value) {
     stringstream s;
-    string prefix = key.substr(3);
-    string val = value;
+    string prefix(key.data() + 3, key.size() - 3);
+    string val = value.ToString();
     if (prefix == "max_path_id"
         || prefix.substr(0,9) == "path_name") {
         stringstream v;
         int64_t id;
-        memcpy(&id, (char*)value.c_str(), sizeof(int64_t));
+        memcpy(&id, value.data(), sizeof(int64_t));
         v << id;
         val = v.str();
     } else if (prefix.substr(0,7) == "path_id") {
@@ -533,7 +784,7 @@ string Index::metadata_entry_to_string(const string& key, const string& value) {
     return s.str();
 }
 
-string Index::mapping_entry_to_string(const string& key, const string& value) {
+string Index::mapping_entry_to_string(const rocksdb::Slice& key, const rocksdb::Slice& value) {
     Mapping mapping;
     int64_t node_id;
     string hash;
@@ -545,7 +796,7 @@ string Index::mapping_entry_to_string(const string& key, const string& value) {
     return s.str();
 }
 
-string Index::alignment_entry_to_string(const string& key, const string& value) {
+string Index::alignment_entry_to_string(const rocksdb::Slice& key, const rocksdb::Slice& value) {
     Alignment alignment;
     int64_t node_id;
     string hash;
@@ -558,98 +809,137 @@ string Index::alignment_entry_to_string(const string& key, const string& value)
 }
 
 void Index::dump(ostream& out) {
-    rocksdb::Iterator* it = db->NewIterator(rocksdb::ReadOptions());
-    for (it->SeekToFirst(); it->Valid(); it->Next()) {
-        out << entry_to_string(it->key().ToString(), it->value().ToString()) << endl;
+    // the kmer family has a prefix extractor, so a full scan must ignore it
+    rocksdb::ReadOptions read_options;
+    read_options.total_order_seek = true;
+    for (auto family : families_in_key_order()) {
+        rocksdb::Iterator* it = db->NewIterator(read_options, family);
+        for (it->SeekToFirst(); it->Valid(); it->Next()) {
+            out << entry_to_string(it->key(), it->value()) << endl;
+        }
+        assert(it->status().ok());  // Check for any errors found during the scan
+        delete it;
     }
-    assert(it->status().ok());  // Check for any errors found during the scan
-    delete it;
 }
 
 void Index::put_node(const Node* node) {
     string data;
     node->SerializeToString(&data);
     string key = key_for_node(node->id());
-    db->Put(write_options, key, data);
+    db->Put(write_options, family_for_type('g'), key, data);
 }
 
 void Index::batch_node(const Node* node, rocksdb::WriteBatch& batch) {
     string data;
     node->SerializeToString(&data);
     string key = key_for_node(node->id());
-    batch.Put(key, data);
+    batch.Put(family_for_type('g'), key, data);
 }
 
 void Index::put_edge(const Edge* edge) {
     string data;
     edge->SerializeToString(&data);
-    db->Put(write_options, key_for_edge_from_to(edge->from(), edge->to()), data);
+    db->Put(write_options, family_for_type('g'), key_for_edge_from_to(edge->from(), edge->to()), data);
     // only store in from_to key
     string null_data;
-    db->Put(write_options, key_for_edge_to_from(edge->to(), edge->from()), null_data);
+    db->Put(write_options, family_for_type('g'), key_for_edge_to_from(edge->to(), edge->from()), null_data);
 }
 
 void Index::batch_edge(const Edge* edge, rocksdb::WriteBatch& batch) {
     string data;
     edge->SerializeToString(&data);
-    db->Put(write_options, key_for_edge_from_to(edge->from(), edge->to()), data);
+    batch.Put(family_for_type('g'), key_for_edge_from_to(edge->from(), edge->to()), data);
     // only store in from_to key
     string null_data;
-    batch.Put(key_for_edge_to_from(edge->to(), edge->from()), null_data);
+    batch.Put(family_for_type('g'), key_for_edge_to_from(edge->to(), edge->from()), null_data);
 }
 
 void Index::put_metadata(const string& tag, const string& data) {
     string key = key_for_metadata(tag);
-    db->Put(write_options, key, data);
+    db->Put(write_options, family_for_type('m'), key, data);
 }
 
 void Index::put_node_path(int64_t node_id, int64_t path_id, int64_t path_pos, const Mapping& mapping) {
     string data;
     mapping.SerializeToString(&data);
-    db->Put(write_options, key_for_node_path_position(node_id, path_id, path_pos), data);
+    db->Put(write_options, family_for_type('g'), key_for_node_path_position(node_id, path_id, path_pos), data);
 }
 
 void Index::put_path_position(int64_t path_id, int64_t path_pos, int64_t node_id, const Mapping& mapping) {
     string data;
     mapping.SerializeToString(&data);
-    db->Put(write_options, key_for_path_position(path_id, path_pos, node_id), data);
+    db->Put(write_options, family_for_type('p'), key_for_path_position(path_id, path_pos, node_id), data);
+}
+
+void Index::batch_node_path(int64_t node_id, int64_t path_id, int64_t path_pos, const Mapping& mapping,
+                            rocksdb::WriteBatch& batch) {
+    string data;
+    mapping.SerializeToString(&data);
+    batch.Put(family_for_type('g'), key_for_node_path_position(node_id, path_id, path_pos), data);
+}
+
+void Index::batch_path_position(int64_t path_id, int64_t path_pos, int64_t node_id, const Mapping& mapping,
+                                rocksdb::WriteBatch& batch) {
+    string data;
+    mapping.SerializeToString(&data);
+    batch.Put(family_for_type('p'), key_for_path_position(path_id, path_pos, node_id), data);
 }
 
 void Index::put_mapping(const Mapping& mapping) {
     string data;
     mapping.SerializeToString(&data);
-    db->Put(write_options, key_for_mapping(mapping), data);
+    db->Put(write_options, family_for_type('s'), key_for_mapping(mapping), data);
 }
 
 void Index::put_alignment(const Alignment& alignment) {
     string data;
     alignment.SerializeToString(&data);
-    db->Put(write_options, key_for_alignment(alignment), data);
+    db->Put(write_options, family_for_type('a'), key_for_alignment(alignment), data);
+}
+
+// how many entries each thread gathers before writing them
+static const int max_batch_entries = 10000;
+
+void Index::write_batch(rocksdb::WriteBatch& batch) {
+    rocksdb::Status s = db->Write(write_options, &batch);
+    if (!s.ok()) {
+        cerr << "error:[vg::Index] could not write to " << name << ": " << s.ToString() << endl;
+        exit(1);
+    }
+    batch.Clear();
 }
 
 void Index::load_graph(VG& graph) {
-    // a bit of a hack--- the logging only works with for_each_*parallel
-    // also the high parallelism may be causing issues
     int thread_count = 1;
 #pragma omp parallel
     {
 #pragma omp master
         thread_count = omp_get_num_threads();
     }
-    omp_set_num_threads(1);
-    graph.create_progress("indexing nodes of " + graph.name, graph.graph.node_size());
-    rocksdb::WriteBatch batch;
-    graph.for_each_node_parallel([this, &batch](Node* n) { batch_node(n, batch); });
-    graph.destroy_progress();
-    graph.create_progress("indexing edges of " + graph.name, graph.graph.edge_size());
-    graph.for_each_edge_parallel([this, &batch](Edge* e) { batch_edge(e, batch); });
-    rocksdb::Status s = db->Write(rocksdb::WriteOptions(), &batch);
-    omp_set_num_threads(thread_count);
+    // batches aren't thread safe, so each thread fills its own, and writes it when it's full
+    vector<rocksdb::WriteBatch> batches(thread_count);
+    graph.for_each_node_parallel([this, &batches](Node* n) {
+            auto& batch = batches[omp_get_thread_num()];
+            batch_node(n, batch);
+            if (batch.Count() >= max_batch_entries) write_batch(batch);
+        });
+    graph.for_each_edge_parallel([this, &batches](Edge* e) {
+            auto& batch = batches[omp_get_thread_num()];
+            batch_edge(e, batch);
+            if (batch.Count() >= max_batch_entries) write_batch(batch);
+        });
+    for (auto& batch : batches) {
+        write_batch(batch);
+    }
 }
 
 void Index::load_paths(VG& graph) {
     graph.destroy_progress();
-    graph.create_progress("indexing paths of " + graph.name, graph.paths._paths.size());
+    int64_t mapping_count = 0;
+    for (auto& p : graph.paths._paths) {
+        mapping_count += p.second.size();
+    }
+    graph.create_progress("indexing paths of " + graph.name, mapping_count);
     store_paths(graph);
     graph.destroy_progress();
 }
@@ -697,6 +987,7 @@ string Index::path_id_prefix(int64_t id) {
 
 void Index::put_path_id_to_name(int64_t id, const string& name) {
     put_metadata(path_id_prefix(id), name);
+    path_names[id] = name;
 }
 
 void Index::put_path_name_to_id(int64_t id, const string& name) {
@@ -704,72 +995,139 @@ void Index::put_path_name_to_id(int64_t id, const string& name) {
     data.resize(sizeof(int64_t));
     memcpy((char*)data.c_str(), &id, sizeof(int64_t));
     put_metadata(path_name_prefix(name), data);
+    path_ids[name] = id;
 }
 
 string Index::get_path_name(int64_t id) {
-    string data;
-    get_metadata(path_id_prefix(id), data);
-    return data;
+    auto p = path_names.find(id);
+    if (p != path_names.end()) {
+        return p->second;
+    }
+    return "";
 }
 
 int64_t Index::get_path_id(const string& name) {
-    string data;
-    get_metadata(path_name_prefix(name), data);
-    int64_t id = 0;
-    memcpy(&id, (char*)data.c_str(), sizeof(int64_t));
-    return id;
+    auto p = path_ids.find(name);
+    if (p != path_ids.end()) {
+        return p->second;
+    }
+    return 0;
 }
 
 void Index::store_paths(VG& graph) {
-    function<void(Path&)> lambda = [this, &graph](Path& path) {
-        store_path(graph, path);
+    // Paths::for_each builds each Path on the fly, so we hold only a bounded group
+    // of them at a time, enough mappings to keep every thread writing
+    int64_t max_group_mappings = (int64_t) max_batch_entries * omp_get_max_threads();
+    int64_t completed = 0;
+    vector<Path> group;
+    int64_t group_mappings = 0;
+    auto store_group = [this, &graph, &group, &group_mappings, &completed](void) {
+        vector<Path*> path_ptrs;
+        for (auto& path : group) {
+            path_ptrs.push_back(&path);
+        }
+        store_paths(graph, path_ptrs, completed);
+        group.clear();
+        group_mappings = 0;
+    };
+    function<void(Path&)> lambda = [&](Path& path) {
+        group_mappings += path.mapping_size();
+        group.emplace_back();
+        group.back().Swap(&path);
+        if (group_mappings >= max_group_mappings) {
+            store_group();
+        }
     };
     graph.paths.for_each(lambda);
+    store_group();
 }
 
 void Index::store_path(VG& graph, Path& path) {
-    // get a new path id
-    // if there is no name, cry
-    if (!path.has_name()) {
-        cerr << "[vg::Index] error, path has no name" << endl;
-        exit(1);
+    vector<Path*> paths(1, &path);
+    store_paths(graph, paths);
+}
+
+void Index::store_paths(VG& graph, const vector<Path*>& paths) {
+    int64_t completed = 0;
+    store_paths(graph, paths, completed);
+}
+
+void Index::store_paths(VG& graph, const vector<Path*>& paths, int64_t& completed) {
+    // ids are handed out through the metadata, so get them first, one path at a time
+    vector<int64_t> ids_of_paths;
+    // and the position in its path of each mapping, from the lengths of the nodes in the graph
+    vector<vector<int64_t> > positions(paths.size());
+    for (size_t p = 0; p < paths.size(); ++p) {
+        Path& path = *paths[p];
+        // if there is no name, cry
+        if (!path.has_name()) {
+            cerr << "[vg::Index] error, path has no name" << endl;
+            exit(1);
+        }
+        // check if the path name/id mapping already exists
+        int64_t path_id = get_path_id(path.name());
+        // if it doesn't, create it
+        if (!path_id) {
+            path_id = new_path_id(path.name());
+        }
+        ids_of_paths.push_back(path_id);
+        auto& path_positions = positions[p];
+        path_positions.resize(path.mapping_size());
+        int64_t path_pos = 0;
+        for (int64_t i = 0; i < path.mapping_size(); ++i) {
+            path_positions[i] = path_pos;
+            int64_t node_id = path.mapping(i).node_id();
+            // TODO use the cigar... if there is one
+            if (graph.has_node(node_id)) {
+                path_pos += graph.get_node(node_id)->sequence().size();
+            } else {
+                // the path runs through a graph stored before this one
+                Node node;
+                get_node(node_id, node);
+                path_pos += node.sequence().size();
+            }
+        }
     }
-    // check if the path name/id mapping already exists
-    int64_t path_id;
-    path_id = get_path_id(path.name());
-    // if it doesn't, create it
-    if (!path_id) {
-        path_id = new_path_id(path.name());
-    }
-    // keep track of position
-    int64_t path_pos = 0;
-    // for each node in the path
-    for (int64_t i = 0; i < path.mapping_size(); ++i) {
-
-        const Mapping& mapping = path.mapping(i);
-        // put an entry in the path table
-        put_path_position(path_id, path_pos, mapping.node_id(), mapping);
-        // put an entry in the graph table
-        put_node_path(mapping.node_id(), path_id, path_pos, mapping);
-
-        // get the node, to find the size of this step
-        Node node;
-        get_node(mapping.node_id(), node);
-        // TODO use the cigar... if there is one
-        path_pos += node.sequence().size();
 
-        graph.update_progress(graph.progress_count+1);
+    // then write the path and node-path entries in bounded chunks of mappings,
+    // concurrently across and within paths
+    vector<pair<size_t, int64_t> > chunks;
+    for (size_t p = 0; p < paths.size(); ++p) {
+        for (int64_t i = 0; i < paths[p]->mapping_size(); i += max_batch_entries / 2) {
+            chunks.push_back(make_pair(p, i));
+        }
+    }
+#pragma omp parallel for schedule(dynamic)
+    for (size_t c = 0; c < chunks.size(); ++c) {
+        size_t p = chunks[c].first;
+        Path& path = *paths[p];
+        int64_t path_id = ids_of_paths[p];
+        int64_t end = min((int64_t) path.mapping_size(), chunks[c].second + max_batch_entries / 2);
+        rocksdb::WriteBatch batch;
+        for (int64_t i = chunks[c].second; i < end; ++i) {
+            const Mapping& mapping = path.mapping(i);
+            // put an entry in the path table
+            batch_path_position(path_id, positions[p][i], mapping.node_id(), mapping, batch);
+            // put an entry in the graph table
+            batch_node_path(mapping.node_id(), path_id, positions[p][i], mapping, batch);
+        }
+        write_batch(batch);
+#pragma omp critical (progress_bar)
+        {
+            completed += end - chunks[c].second;
+            graph.update_progress(completed);
+        }
     }
 }
 
 rocksdb::Status Index::get_metadata(const string& key, string& data) {
-    rocksdb::Status s = db->Get(rocksdb::ReadOptions(), key_for_metadata(key), &data);
+    rocksdb::Status s = db->Get(rocksdb::ReadOptions(), family_for_type('m'), key_for_metadata(key), &data);
     return s;
 }
 
 rocksdb::Status Index::get_node(int64_t id, Node& node) {
     string value;
-    rocksdb::Status s = db->Get(rocksdb::ReadOptions(), key_for_node(id), &value);
+    rocksdb::Status s = db->Get(rocksdb::ReadOptions(), family_for_type('g'), key_for_node(id), &value);
     if (s.ok()) {
         node.ParseFromString(value);
     }
@@ -778,7 +1136,7 @@ rocksdb::Status Index::get_node(int64_t id, Node& node) {
 
 rocksdb::Status Index::get_edge(int64_t from, int64_t to, Edge& edge) {
     string value;
-    rocksdb::Status s = db->Get(rocksdb::ReadOptions(), key_for_edge_from_to(from, to), &value);
+    rocksdb::Status s = db->Get(rocksdb::ReadOptions(), family_for_type('g'), key_for_edge_from_to(from, to), &value);
     if (s.ok()) {
         edge.ParseFromString(value);
     }
@@ -788,20 +1146,20 @@ rocksdb::Status Index::get_edge(int64_t from, int64_t to, Edge& edge) {
 void Index::get_mappings(int64_t node_id, vector<Mapping>& mappings) {
     string start = key_for_mapping_prefix(node_id);
     string end = start + end_sep;
-    for_range(start, end, [this, &mappings](string& key, string& value) {
+    for_slice_range(start, end, [this, &mappings](const rocksdb::Slice& key, const rocksdb::Slice& value) {
             mappings.emplace_back();
             Mapping& mapping = mappings.back();
-            mapping.ParseFromString(value);
+            mapping.ParseFromArray(value.data(), value.size());
         });
 }
 
 void Index::get_alignments(int64_t node_id, vector<Alignment>& alignments) {
     string start = key_for_alignment_prefix(node_id);
     string end = start + end_sep;
-    for_range(start, end, [this, &alignments](string& key, string& value) {
+    for_slice_range(start, end, [this, &alignments](const rocksdb::Slice& key, const rocksdb::Slice& value) {
             alignments.emplace_back();
             Alignment& alignment = alignments.back();
-            alignment.ParseFromString(value);
+            alignment.ParseFromArray(value.data(), value.size());
         });
 }
 
@@ -813,7 +1171,7 @@ int Index::get_node_path(int64_t node_id, int64_t path_id, int64_t& path_pos, Ma
     // NB: uses the first position in the range
     // apply to the range matching the kmer in the db
     int count = 0;
-    for_range(start, end, [this, &count, &node_id, &path_id, &path_pos, &mapping](string& key, string& value) {
+    for_slice_range(start, end, [this, &count, &node_id, &path_id, &path_pos, &mapping](const rocksdb::Slice& key, const rocksdb::Slice& value) {
             if (count == 0) {
                 parse_node_path(key, value,
                                 node_id, path_id,
@@ -1043,16 +1401,14 @@ map<string, int64_t> Index::paths_by_id(void) {
 int64_t Index::path_first_node(int64_t path_id) {
     string k = key_for_path_position(path_id, 0, 0);
     k = k.substr(0, 4 + sizeof(int64_t));
-    rocksdb::Iterator* it = db->NewIterator(rocksdb::ReadOptions());
+    rocksdb::Iterator* it = db->NewIterator(rocksdb::ReadOptions(), family_for_type('p'));
     rocksdb::Slice start = rocksdb::Slice(k);
     rocksdb::Slice end = rocksdb::Slice(k+end_sep);
     int64_t node_id = 0;
     it->Seek(start);
     if (it->Valid()) {
-        string key = it->key().ToString();
-        string value = it->value().ToString();
         int64_t path_id2, path_pos; Mapping mapping;
-        parse_path_position(key, value, path_id2, path_pos, node_id, mapping);
+        parse_path_position(it->key(), it->value(), path_id2, path_pos, node_id, mapping);
     }
     delete it;
     return node_id;
@@ -1062,7 +1418,7 @@ int64_t Index::path_last_node(int64_t path_id, int64_t& path_length) {
     // we aim to seek to the first item in the next path, then step back
     string key_start = key_for_path_position(path_id, 0, 0);
     string key_end = key_for_path_position(path_id+1, 0, 0);
-    rocksdb::Iterator* it = db->NewIterator(rocksdb::ReadOptions());
+    rocksdb::Iterator* it = db->NewIterator(rocksdb::ReadOptions(), family_for_type('p'));
     //rocksdb::Slice start = rocksdb::Slice(key_start);
     rocksdb::Slice end = rocksdb::Slice(key_end);
     int64_t node_id = 0;
@@ -1071,10 +1427,8 @@ int64_t Index::path_last_node(int64_t path_id, int64_t& path_length) {
     // horrible hack
     if (!it->Valid()) it->SeekToLast(); // XXXX
     if (it->Valid()) {
-        string key = it->key().ToString();
-        string value = it->value().ToString();
         int64_t path_id2, path_pos; Mapping mapping;
-        parse_path_position(key, value, path_id2, path_pos, node_id, mapping);
+        parse_path_position(it->key(), it->value(), path_id2, path_pos, node_id, mapping);
         Node node; get_node(node_id, node);
         path_length = path_pos + node.sequence().size();
     }
@@ -1096,21 +1450,21 @@ void Index::path_layout(map<string, pair<int64_t, int64_t> >& layout,
 }
 
 void Index::for_each_alignment(function<void(const Alignment&)> lambda) {
-    string start = start_sep + "a";
+    string start = key_for_alignment_prefix(0).substr(0, 3);
     string end = start + end_sep;
-    for_range(start, end, [this, &lambda](string& key, string& value) {
+    for_slice_range(start, end, [this, &lambda](const rocksdb::Slice& key, const rocksdb::Slice& value) {
             Alignment alignment;
-            alignment.ParseFromString(value);
+            alignment.ParseFromArray(value.data(), value.size());
             lambda(alignment);
         });
 }
 
 void Index::for_each_mapping(function<void(const Mapping&)> lambda) {
-    string start = start_sep + "a";
+    string start = key_for_mapping_prefix(0).substr(0, 3);
     string end = start + end_sep;
-    for_range(start, end, [this, &lambda](string& key, string& value) {
+    for_slice_range(start, end, [this, &lambda](const rocksdb::Slice& key, const rocksdb::Slice& value) {
             Mapping mapping;
-            mapping.ParseFromString(value);
+            mapping.ParseFromArray(value.data(), value.size());
             lambda(mapping);
         });
 }
@@ -1148,98 +1502,61 @@ void Index::get_connected_nodes(VG& graph) {
 }
 
 void Index::get_context(int64_t id, VG& graph) {
-    rocksdb::Iterator* it = db->NewIterator(rocksdb::ReadOptions());
     string key_start = key_for_node(id).substr(0,3+sizeof(int64_t));
-    rocksdb::Slice start = rocksdb::Slice(key_start);
     string key_end = key_start+end_sep;
-    rocksdb::Slice end = rocksdb::Slice(key_end);
-    for (it->Seek(start);
-         it->Valid() && it->key().ToString() < key_end;
-         it->Next()) {
-        string s = it->key().ToString();
-        char keyt = graph_key_type(s);
-        switch (keyt) {
-        case 'n': {
-            Node node;
-            node.ParseFromString(it->value().ToString());
-            graph.add_node(node);
-        } break;
-        case 'f': {
-            Edge edge;
-            int64_t id1, id2;
-            char type;
-            parse_edge(it->key().ToString(), it->value().ToString(), type, id1, id2, edge);
-            graph.add_edge(edge);
-        } break;
-        case 't': {
-            Edge edge;
-            int64_t id1, id2;
-            char type;
-            parse_edge(it->key().ToString(), it->value().ToString(), type, id1, id2, edge);
-            // avoid a second lookup
-            // probably we should index these twice and pay the penalty on *write* rather than read
-            //get_edge(id2, id1, edge);
-            graph.add_edge(edge);
-
-        } break;
-        case 'p': {
-            int64_t node_id, path_id, path_pos;
-            Mapping mapping;
-            parse_node_path(it->key().ToString(), it->value().ToString(),
-                            node_id, path_id, path_pos, mapping);
-            graph.paths.append_mapping(get_path_name(path_id), mapping);
-        } break;
-        default:
-            cerr << "vg::Index unrecognized key type " << keyt << endl;
-            exit(1);
-            break;
-        }
+    for_slice_range(key_start, key_end, [this, &graph](const rocksdb::Slice& key, const rocksdb::Slice& value) {
+            add_graph_entry(key, value, graph);
+        });
+}
+
+void Index::add_graph_entry(const rocksdb::Slice& key, const rocksdb::Slice& value, VG& graph) {
+    char keyt = graph_key_type(key);
+    switch (keyt) {
+    case 'n': {
+        Node node;
+        node.ParseFromArray(value.data(), value.size());
+        graph.add_node(node);
+    } break;
+    case 'f': {
+        Edge edge;
+        int64_t id1, id2;
+        char type;
+        parse_edge(key, value, type, id1, id2, edge);
+        graph.add_edge(edge);
+    } break;
+    case 't': {
+        Edge edge;
+        int64_t id1, id2;
+        char type;
+        parse_edge(key, value, type, id1, id2, edge);
+        // avoid a second lookup
+        // probably we should index these twice and pay the penalty on *write* rather than read
+        //get_edge(id2, id1, edge);
+        graph.add_edge(edge);
+    } break;
+    case 'p': {
+        int64_t node_id, path_id, path_pos;
+        Mapping mapping;
+        parse_node_path(key, value,
+                        node_id, path_id, path_pos, mapping);
+        graph.paths.append_mapping(get_path_name(path_id), mapping);
+    } break;
+    default:
+        cerr << "vg::Index unrecognized key type " << keyt << endl;
+        exit(1);
+        break;
     }
-    delete it;
 }
 
 void Index::get_range(int64_t from_id, int64_t to_id, VG& graph) {
-    auto handle_entry = [this, &graph](string& key, string& value) {
-        char keyt = graph_key_type(key);
-        switch (keyt) {
-        case 'n': {
-            Node node;
-            node.ParseFromString(value);
-            graph.add_node(node);
-        } break;
-        case 'f': {
-            Edge edge;
-            int64_t id1, id2;
-            char type;
-            parse_edge(key, value, type, id1, id2, edge);
-            graph.add_edge(edge);
-        } break;
-        case 't': {
-            Edge edge;
-            int64_t id1, id2;
-            char type;
-            parse_edge(key, value, type, id1, id2, edge);
-            graph.add_edge(edge);
-        } break;
-        case 'p': {
-            int64_t node_id, path_id, path_pos;
-            Mapping mapping;
-            parse_node_path(key, value,
-                            node_id, path_id, path_pos, mapping);
-            graph.paths.append_mapping(get_path_name(path_id), mapping);
-        } break;
-        default:
-            cerr << "vg::Index unrecognized key type " << keyt << endl;
-            exit(1);
-            break;
-        }
-    };
-    for_graph_range(from_id, to_id, handle_entry);
+    for_graph_range(from_id, to_id, [this, &graph](const rocksdb::Slice& key, const rocksdb::Slice& value) {
+            add_graph_entry(key, value, graph);
+        });
 }
 
 void Index::get_kmer_subgraph(const string& kmer, VG& graph) {
     // get the nodes in the kmer subgraph
-    for_kmer_range(kmer, [&graph, this](string& key, string& value) {
+    for_kmer_range(kmer, [&graph, this](const rocksdb::Slice& key, const rocksdb::Slice& value) {
             int64_t id;
             string kmer;
             int32_t pos;
@@ -1249,7 +1566,7 @@ void Index::get_kmer_subgraph(const string& kmer, VG& graph) {
 }
 
 void Index::get_kmer_positions(const string& kmer, map<int64_t, vector<int32_t> >& positions) {
-    for_kmer_range(kmer, [&positions, this](string& key, string& value) {
+    for_kmer_range(kmer, [&positions, this](const rocksdb::Slice& key, const rocksdb::Slice& value) {
             int64_t id;
             string kmer;
             int32_t pos;
@@ -1259,7 +1576,7 @@ void Index::get_kmer_positions(const string& kmer, map<int64_t, vector<int32_t>
 }
 
 void Index::get_kmer_positions(const string& kmer, map<string, vector<pair<int64_t, int32_t> > >& positions) {
-    for_kmer_range(kmer, [&positions, this](string& key, string& value) {
+    for_kmer_range(kmer, [&positions, this](const rocksdb::Slice& key, const rocksdb::Slice& value) {
             int64_t id;
             string kmer;
             int32_t pos;
@@ -1268,19 +1585,66 @@ void Index::get_kmer_positions(const string& kmer, map<string, vector<pair<int64
         });
 }
 
-void Index::for_kmer_range(const string& kmer, function<void(string&, string&)> lambda) {
+void Index::get_kmer_positions(const vector<string>& kmers, vector<map<int64_t, vector<int32_t> > >& positions) {
+    positions.clear();
+    positions.resize(kmers.size());
+    // visit the kmers in key order so one iterator only ever seeks forward
+    // each seek is to the prefix of one kmer, so kmers not in the index are ruled out by the bloom filters
+    vector<string> prefixes;
+    prefixes.reserve(kmers.size());
+    for (auto& kmer : kmers) {
+        prefixes.push_back(key_prefix_for_kmer(kmer));
+    }
+    vector<size_t> order(kmers.size());
+    for (size_t i = 0; i < order.size(); ++i) order[i] = i;
+    std::sort(order.begin(), order.end(), [&prefixes](size_t a, size_t b) { return prefixes[a] < prefixes[b]; });
+    rocksdb::Iterator* it = db->NewIterator(rocksdb::ReadOptions(), family_for_type('k'));
+    for (size_t j = 0; j < order.size(); ++j) {
+        size_t i = order[j];
+        // duplicate kmers share the result of the first lookup
+        if (j > 0 && kmers[order[j-1]] == kmers[i]) {
+            positions[i] = positions[order[j-1]];
+            continue;
+        }
+        string start = prefixes[i];
+        string end = start + end_sep;
+        start = start + start_sep;
+        auto& kmer_positions = positions[i];
+        for (it->Seek(start);
+             it->Valid() && it->key().compare(end) < 0;
+             it->Next()) {
+            int64_t id;
+            string kmer;
+            int32_t pos;
+            parse_kmer(it->key(), it->value(), kmer, id, pos);
+            kmer_positions[id].push_back(pos);
+        }
+    }
+    delete it;
+}
+
+void Index::for_kmer_range(const string& kmer, function<void(const rocksdb::Slice&, const rocksdb::Slice&)> lambda) {
     string start = key_prefix_for_kmer(kmer);
-    string end = start + end_sep;
+    string key_end = start + end_sep;
     start = start + start_sep;
-    // apply to the range matching the kmer in the db
-    for_range(start, end, lambda);
+    rocksdb::Slice end = rocksdb::Slice(key_end);
+    // the keys of the kmer share a prefix, so this is a prefix seek, which the bloom filters can answer
+    rocksdb::ReadOptions read_options;
+    read_options.iterate_upper_bound = &end;
+    rocksdb::Iterator* it = db->NewIterator(read_options, family_for_type('k'));
+    for (it->Seek(start);
+         it->Valid() && it->key().compare(end) < 0;
+         it->Next()) {
+        lambda(it->key(), it->value());
+    }
+    delete it;
 }
 
-void Index::for_graph_range(int64_t from_id, int64_t to_id, function<void(string&, string&)> lambda) {
+void Index::for_graph_range(int64_t from_id, int64_t to_id, function<void(const rocksdb::Slice&, const rocksdb::Slice&)> lambda) {
     string start = key_for_node(from_id);
     string end = key_for_node(to_id+1);
     // apply to the range matching the kmer in the db
-    for_range(start, end, lambda);
+    for_slice_range(start, end, lambda);
 }
 
 uint64_t Index::approx_size_of_kmer_matches(const string& kmer) {
@@ -1288,76 +1652,75 @@ uint64_t Index::approx_size_of_kmer_matches(const string& kmer) {
     string start = key_prefix_for_kmer(kmer);
     string end = start + end_sep;
     rocksdb::Range range = rocksdb::Range(start, end);
-    db->GetApproximateSizes(&range, 1, &size);
+    db->GetApproximateSizes(family_for_type('k'), &range, 1, &size);
     return size;
 }
 
 void Index::approx_sizes_of_kmer_matches(const vector<string>& kmers, vector<uint64_t>& sizes) {
     sizes.resize(kmers.size());
-    vector<rocksdb::Range> ranges;
+    if (kmers.empty()) return;
+    // the ranges only hold slices, so keep the keys alive until the call returns
+    vector<string> keys;
+    keys.reserve(2*kmers.size());
     for (auto& kmer : kmers) {
-        string start = key_prefix_for_kmer(kmer);
-        string end = start + end_sep;
-        ranges.push_back(rocksdb::Range(start, end));
+        keys.push_back(key_prefix_for_kmer(kmer));
+        keys.push_back(keys.back() + end_sep);
     }
-    db->GetApproximateSizes(&ranges[0], kmers.size(), &sizes[0]);
+    vector<rocksdb::Range> ranges;
+    for (size_t i = 0; i < kmers.size(); ++i) {
+        ranges.push_back(rocksdb::Range(keys[2*i], keys[2*i+1]));
+    }
+    db->GetApproximateSizes(family_for_type('k'), &ranges[0], kmers.size(), &sizes[0]);
+}
+
+void Index::get_edges_of(int64_t id, vector<Edge>& edges) {
+    get_edges_from(id, edges);
+    get_edges_to(id, edges);
 }
 
 void Index::get_edges_from(int64_t from, vector<Edge>& edges) {
-    rocksdb::Iterator* it = db->NewIterator(rocksdb::ReadOptions());
     string key_start = key_prefix_for_edges_from_node(from);
-    rocksdb::Slice start = rocksdb::Slice(key_start);
     string key_end = key_start+end_sep;
-    rocksdb::Slice end = rocksdb::Slice(key_end);
-    for (it->Seek(start);
-         it->Valid() && it->key().ToString() < key_end;
-         it->Next()) {
-        string s = it->key().ToString();
-        char keyt = graph_key_type(s);
-        switch (keyt) {
-        case 'f': {
-            Edge edge;
-            int64_t id1, id2;
-            char type;
-            parse_edge(it->key().ToString(), it->value().ToString(), type, id1, id2, edge);
-            edges.push_back(edge);
-        } break;
-        default:
-            // there should only be edges from here
-            cerr << keyt << endl;
-            assert(false);
-            break;
-        }
-    }
+    for_slice_range(key_start, key_end, [this, &edges](const rocksdb::Slice& key, const rocksdb::Slice& value) {
+            char keyt = graph_key_type(key);
+            switch (keyt) {
+            case 'f': {
+                Edge edge;
+                int64_t id1, id2;
+                char type;
+                parse_edge(key, value, type, id1, id2, edge);
+                edges.push_back(edge);
+            } break;
+            default:
+                // there should only be edges from here
+                cerr << keyt << endl;
+                assert(false);
+                break;
+            }
+        });
 }
 
 void Index::get_edges_to(int64_t to, vector<Edge>& edges) {
-    rocksdb::Iterator* it = db->NewIterator(rocksdb::ReadOptions());
     string key_start = key_prefix_for_edges_to_node(to);
-    rocksdb::Slice start = rocksdb::Slice(key_start);
     string key_end = key_start+end_sep;
-    rocksdb::Slice end = rocksdb::Slice(key_end);
-    for (it->Seek(start);
-         it->Valid() && it->key().ToString() < key_end;
-         it->Next()) {
-        string s = it->key().ToString();
-        char keyt = graph_key_type(s);
-        switch (keyt) {
-        case 't': {
-            Edge edge;
-            int64_t id1, id2;
-            char type;
-            parse_edge(it->key().ToString(), it->value().ToString(), type, id1, id2, edge);
-            get_edge(id2, id1, edge);
-            edges.push_back(edge);
-        } break;
-        default:
-            // there should only be edges from here
-            cerr << keyt << endl;
-            assert(false);
-            break;
-        }
-    }
+    for_slice_range(key_start, key_end, [this, &edges](const rocksdb::Slice& key, const rocksdb::Slice& value) {
+            char keyt = graph_key_type(key);
+            switch (keyt) {
+            case 't': {
+                Edge edge;
+                int64_t id1, id2;
+                char type;
+                parse_edge(key, value, type, id1, id2, edge);
+                get_edge(id2, id1, edge);
+                edges.push_back(edge);
+            } break;
+            default:
+                // there should only be edges to here
+                cerr << keyt << endl;
+                assert(false);
+                break;
+            }
+        });
 }
 
 void Index::get_path(VG& graph, const string& name, int64_t start, int64_t end) {
@@ -1368,7 +1731,7 @@ void Index::get_path(VG& graph, const string& name, int64_t start, int64_t end)
     int64_t path_id = get_path_id(name);
     string key_start = key_for_path_position(path_id, start, 0);
     string key_end = key_for_path_position(path_id, end, 0);
-    for_range(key_start, key_end, [this, &graph](string& key, string& data) {
+    for_slice_range(key_start, key_end, [this, &graph](const rocksdb::Slice& key, const rocksdb::Slice& data) {
             Mapping mapping;
             int64_t path_id, path_pos, node_id;
             parse_path_position(key, data,
@@ -1392,7 +1755,7 @@ void Index::put_kmer(const string& kmer,
     string key = key_for_kmer(kmer, id);
     string data(sizeof(int32_t), '\0');
     memcpy((char*)data.c_str(), &pos, sizeof(int32_t));
-    rocksdb::Status s = db->Put(write_options, key, data);
+    rocksdb::Status s = db->Put(write_options, family_for_type('k'), key, data);
     if (!s.ok()) { cerr << "put of " << kmer << " " << id << "@" << pos << " failed" << endl; exit(1); }
 }
 
@@ -1403,7 +1766,7 @@ void Index::batch_kmer(const string& kmer,
     string key = key_for_kmer(kmer, id);
     string data(sizeof(int32_t), '\0');
     memcpy((char*) data.c_str(), &pos, sizeof(int32_t));
-    batch.Put(key, data);
+    batch.Put(family_for_type('k'), key, data);
 }
 
 void Index::store_batch(map<string, string>& items) {
@@ -1411,12 +1774,72 @@ void Index::store_batch(map<string, string>& items) {
     for (auto& i : items) {
         const string& k = i.first;
         const string& v = i.second;
-        batch.Put(k, v);
+        batch.Put(family_for_key(k), k, v);
     }
     rocksdb::Status s = db->Write(write_options, &batch);
     if (!s.ok()) cerr << "an error occurred while inserting items" << endl;
 }
 
+string Index::write_sorted_run(vector<pair<string, string> >& entries) {
+    return vg::write_sorted_run(name, entries);
+}
+
+void Index::merge_sorted_runs(vector<string> runs, function<void(const string&, const string&)> lambda) {
+    vg::merge_sorted_runs(name, runs, lambda);
+}
+
+void Index::ingest_sorted_runs(const vector<string>& runs, char key_type) {
+    rocksdb::ColumnFamilyHandle* family = family_for_type(key_type);
+    // the files must be written with the options of the column family they go into
+    rocksdb::Options options = db_options;
+    if (!legacy_layout) {
+        options = rocksdb::Options(db_options, GetColumnFamilyOptions(key_type));
+    }
+    vector<string> files;
+    rocksdb::SstFileWriter* writer = NULL;
+    auto finish_file = [&writer, &files]() {
+        rocksdb::Status s = writer->Finish();
+        if (!s.ok()) {
+            cerr << "error:[vg::Index] could not write " << files.back() << endl;
+            exit(1);
+        }
+        delete writer;
+        writer = NULL;
+    };
+    merge_sorted_runs(runs, [&](const string& key, const string& value) {
+            if (writer && writer->FileSize() >= options.target_file_size_base) {
+                finish_file();
+            }
+            if (!writer) {
+                stringstream n;
+                n << name << ".ingest." << getpid() << "." << files.size() << ".sst";
+                files.push_back(n.str());
+                writer = new rocksdb::SstFileWriter(rocksdb::EnvOptions(), options, family);
+                if (!writer->Open(files.back()).ok()) {
+                    cerr << "error:[vg::Index] could not open " << files.back() << endl;
+                    exit(1);
+                }
+            }
+            writer->Put(key, value);
+        });
+    if (writer) {
+        finish_file();
+    }
+    if (files.empty()) return;
+    // the files don't overlap, so they go straight to the bottom of the tree
+    rocksdb::IngestExternalFileOptions ingest_options;
+    ingest_options.move_files = true;
+    rocksdb::Status s = db->IngestExternalFile(family, files, ingest_options);
+    if (!s.ok()) {
+        cerr << "error:[vg::Index] could not ingest sorted entries: " << s.ToString() << endl;
+        exit(1);
+    }
+    // if they could only be copied, the originals are still here
+    for (auto& file : files) {
+        std::remove(file.c_str());
+    }
+}
+
 void Index::for_all(std::function<void(string&, string&)> lambda) {
     string start(1, start_sep);
     string end(1, end_sep);
@@ -1425,40 +1848,94 @@ void Index::for_all(std::function<void(string&, string&)> lambda) {
 
 void Index::for_range(string& key_start, string& key_end,
                       std::function<void(string&, string&)> lambda) {
-    rocksdb::Iterator* it = db->NewIterator(rocksdb::ReadOptions());
-    rocksdb::Slice start = rocksdb::Slice(key_start);
+    for_slice_range(key_start, key_end, [&lambda](const rocksdb::Slice& k, const rocksdb::Slice& v) {
+            string key = k.ToString();
+            string value = v.ToString();
+            lambda(key, value);
+        });
+}
+
+void Index::for_range(rocksdb::ColumnFamilyHandle* family,
+                      string& key_start, string& key_end,
+                      std::function<void(string&, string&)> lambda) {
+    for_slice_range(family, key_start, key_end, [&lambda](const rocksdb::Slice& k, const rocksdb::Slice& v) {
+            string key = k.ToString();
+            string value = v.ToString();
+            lambda(key, value);
+        });
+}
+
+void Index::for_slice_range(const string& key_start, const string& key_end,
+                            std::function<void(const rocksdb::Slice&, const rocksdb::Slice&)> lambda) {
+    // a range within one namespace only needs to read its column family
+    if (key_start.size() > 1 && key_end.size() > 1 && key_start[1] == key_end[1]) {
+        for_slice_range(family_for_key(key_start), key_start, key_end, lambda);
+    } else {
+        for (auto family : families_in_key_order()) {
+            for_slice_range(family, key_start, key_end, lambda);
+        }
+    }
+}
+
+void Index::for_slice_range(rocksdb::ColumnFamilyHandle* family,
+                            const string& key_start, const string& key_end,
+                            std::function<void(const rocksdb::Slice&, const rocksdb::Slice&)> lambda) {
     rocksdb::Slice end = rocksdb::Slice(key_end);
-    for (it->Seek(start);
-         it->Valid() && it->key().ToString() < key_end;
+    rocksdb::ReadOptions read_options;
+    // ranges may span many kmer prefixes, so ignore the prefix extractor
+    read_options.total_order_seek = true;
+    // lets rocksdb stop at the end of the range rather than reading on into the next block
+    read_options.iterate_upper_bound = &end;
+    rocksdb::Iterator* it = db->NewIterator(read_options, family);
+    for (it->Seek(key_start);
+         it->Valid() && it->key().compare(end) < 0;
          it->Next()) {
-        string key = it->key().ToString();
-        string value = it->value().ToString();
-        lambda(key, value);
+        lambda(it->key(), it->value());
     }
     delete it;
 }
 
 // todo, get range estimated size
 
-void Index::prune_kmers(int max_kb_on_disk) {
-    string start = key_prefix_for_kmer("");
+void Index::prune_kmers(int max_hits) {
+    // all the kmers, packed or not
+    string start = key_prefix_for_kmer("").substr(0, 3);
     string end = start + end_sep;
-    for_range(start, end, [this, max_kb_on_disk](string& key, string& value) {
-            string kmer;
-            int64_t id;
-            int32_t pos;
-            parse_kmer(key, value, kmer, id, pos);
-            if (approx_size_of_kmer_matches(kmer) > max_kb_on_disk) {
-                //cerr << "pruning kmer " << kmer << endl;
-                db->Delete(write_options, key);
+    rocksdb::ColumnFamilyHandle* family = family_for_type('k');
+    // the entries of each kmer are adjacent, so one pass counts them exactly
+    rocksdb::WriteBatch batch;
+    string prefix;
+    int64_t hits = 0;
+    auto prune = [this, &batch, &prefix, &hits, max_hits, family](void) {
+        if (hits > max_hits) {
+            batch.DeleteRange(family, prefix + start_sep, prefix + end_sep);
+            if (batch.Count() >= max_batch_entries) write_batch(batch);
+        }
+    };
+    for_slice_range(family, start, end, [&](const rocksdb::Slice& key, const rocksdb::Slice& value) {
+            size_t length = kmer_prefix_length(key, start_sep);
+            if (length == 0) return;
+            // drop the separator, so the prefix is that of key_prefix_for_kmer
+            rocksdb::Slice kmer_prefix(key.data(), length - 1);
+            if (kmer_prefix.compare(prefix) != 0) {
+                prune();
+                prefix = kmer_prefix.ToString();
+                hits = 0;
             }
+            ++hits;
         });
+    prune();
+    write_batch(batch);
 }
 
 void Index::remember_kmer_size(int size) {
     stringstream s;
     s << "k=" << size;
     put_metadata(s.str(), "");
+    // readers need to know how the kmers are keyed
+    if (packed_kmers) {
+        put_metadata("packed_kmers", "");
+    }
 }
 
 set<int> Index::stored_kmer_sizes(void) {
@@ -1473,6 +1950,30 @@ set<int> Index::stored_kmer_sizes(void) {
     return sizes;
 }
 
+void Index::remember_input(const string& stage, const string& file_name, const string& fingerprint) {
+    put_metadata("input:" + stage + ":" + file_name, fingerprint);
+}
+
+string Index::indexed_input(const string& stage, const string& file_name) {
+    string data;
+    rocksdb::Status s = get_metadata("input:" + stage + ":" + file_name, data);
+    return s.ok() ? data : "";
+}
+
+void Index::remember_minimizer_window(int window) {
+    stringstream s;
+    s << window;
+    put_metadata("minimizer_window", s.str());
+}
+
+int Index::stored_minimizer_window(void) {
+    string data;
+    rocksdb::Status s = get_metadata("minimizer_window", data);
+    if (!s.ok()) {
+        return 0;
+    }
+    return atoi(data.c_str());
+}
 
 void index_positions(VG& graph, map<long, Node*>& node_path, map<long, Edge*>& edge_path) {
 
@@ -16,6 +16,15 @@
 #include "rocksdb/slice_transform.h"
 #include "rocksdb/table.h"
 #include "rocksdb/filter_policy.h"
+#include "rocksdb/sst_file_writer.h"
+#include "rocksdb/version.h"
+
+// the kmers are bulk loaded by writing sst files for the kmer column family and
+// ingesting them (SstFileWriter::FileSize, DB::IngestExternalFile), and pruned
+// with WriteBatch::DeleteRange, which need the rocksdb release the submodule tracks
+#if ROCKSDB_MAJOR < 5 || (ROCKSDB_MAJOR == 5 && ROCKSDB_MINOR < 8)
+#error "vg needs RocksDB 5.8 or later, run git submodule update --remote rocksdb"
+#endif
 
 #include "pb2json.h"
 #include "vg.hpp"
@@ -67,10 +76,26 @@ namespace vg {
   +g+to_id+t+from_id         null // already stored under from_id+to_id, but this provides reverse index
   +g+node_id+p+path_id+pos   mapping [vg::Mapping]
   +k+kmer+node_id            position of kmer in node [int32_t]
+  +K+length packed+node_id   as above, with the kmer packed 2 bits per base (see packed_kmers)
   +p+path_id+pos+node_id     mapping [vg::Mapping]
   +s+node_id+offset          mapping [vg::Mapping] // mapping-only "side" against one node
   +a+node_id+offset          alignment [vg::Alignment]
 
+  Each namespace is kept in its own column family, named below, so that each
+  can have options suited to how it is used and can be compacted or dropped
+  without rewriting the others. Keys keep their namespace prefix.
+
+  m metadata   a few small entries
+  g graph      small blocks, with index and filter blocks held in the block cache
+  k kmers      the bulk of the index, bloom filtered on the +k+kmer+ prefix
+               so lookups of kmers not in the graph read no data blocks
+  p paths      scanned in order
+  s mappings   larger blocks, strongly compressed
+  a alignments larger blocks, strongly compressed
+
+  Indexes written before this have only the default column family, which then
+  holds every namespace.
+
  */
 
 class Index {
@@ -82,6 +107,8 @@ public:
     ~Index(void);
 
     rocksdb::Options GetOptions(void);
+    // the options for the column family of a namespace, built on GetOptions()
+    rocksdb::ColumnFamilyOptions GetColumnFamilyOptions(char key_type);
     void open(const std::string& dir, bool read_only = false);
     void open_read_only(string& dir);
     void open_for_write(string& dir);
@@ -103,8 +130,21 @@ public:
     rocksdb::Options db_options;
     rocksdb::WriteOptions write_options;
     rocksdb::ColumnFamilyOptions column_family_options;
+    // every handle we opened, for closing
+    vector<rocksdb::ColumnFamilyHandle*> column_families;
+    // the column family of each key namespace
+    map<char, rocksdb::ColumnFamilyHandle*> namespace_families;
+    bool legacy_layout; // all namespaces are in the default column family
+    shared_ptr<rocksdb::Cache> block_cache;
+    rocksdb::ColumnFamilyHandle* family_for_type(char key_type);
+    rocksdb::ColumnFamilyHandle* family_for_key(const string& key);
+    // each distinct column family once, in the order of their namespaces' keys
+    vector<rocksdb::ColumnFamilyHandle*> families_in_key_order(void);
     bool bulk_load;
     bool mem_env;
+    // store kmers as +K+ keys, ACGT only and at most 255bp, but about a third the size
+    // set before opening to create them, and set on open if the index has them
+    bool packed_kmers;
     size_t block_cache_size;
 
     void load_graph(VG& graph);
@@ -112,6 +152,15 @@ public:
     void for_all(std::function<void(string&, string&)> lambda);
     void for_range(string& key_start, string& key_end,
                    std::function<void(string&, string&)> lambda);
+    void for_range(rocksdb::ColumnFamilyHandle* family,
+                   string& key_start, string& key_end,
+                   std::function<void(string&, string&)> lambda);
+    // as above, but without copying, the slices are only valid during the callback
+    void for_slice_range(const string& key_start, const string& key_end,
+                         std::function<void(const rocksdb::Slice&, const rocksdb::Slice&)> lambda);
+    void for_slice_range(rocksdb::ColumnFamilyHandle* family,
+                         const string& key_start, const string& key_end,
+                         std::function<void(const rocksdb::Slice&, const rocksdb::Slice&)> lambda);
 
     void put_node(const Node* node);
     void put_edge(const Edge* edge);
@@ -127,6 +176,12 @@ public:
     void put_metadata(const string& tag, const string& data);
     void put_node_path(int64_t node_id, int64_t path_id, int64_t path_pos, const Mapping& mapping);
     void put_path_position(int64_t path_id, int64_t path_pos, int64_t node_id, const Mapping& mapping);
+    void batch_node_path(int64_t node_id, int64_t path_id, int64_t path_pos, const Mapping& mapping,
+                         rocksdb::WriteBatch& batch);
+    void batch_path_position(int64_t path_id, int64_t path_pos, int64_t node_id, const Mapping& mapping,
+                             rocksdb::WriteBatch& batch);
+    // writes the batch and clears it
+    void write_batch(rocksdb::WriteBatch& batch);
     void put_mapping(const Mapping& mapping);
     void put_alignment(const Alignment& alignment);
 
@@ -155,32 +210,34 @@ public:
     const string key_for_alignment(const Alignment& alignment);
 
     // deserialize a key/value pair
-    void parse_node(const string& key, const string& value, int64_t& id, Node& node);
-    void parse_edge(const string& key, const string& value, char& type, int64_t& id1, int64_t& id2, Edge& edge);
-    void parse_kmer(const string& key, const string& value, string& kmer, int64_t& id, int32_t& pos);
-    void parse_node_path(const string& key, const string& value,
+    void parse_node(const rocksdb::Slice& key, const rocksdb::Slice& value, int64_t& id, Node& node);
+    void parse_edge(const rocksdb::Slice& key, const rocksdb::Slice& value, char& type, int64_t& id1, int64_t& id2, Edge& edge);
+    void parse_kmer(const rocksdb::Slice& key, const rocksdb::Slice& value, string& kmer, int64_t& id, int32_t& pos);
+    void parse_node_path(const rocksdb::Slice& key, const rocksdb::Slice& value,
                          int64_t& node_id, int64_t& path_id, int64_t& path_pos, Mapping& mapping);
-    void parse_path_position(const string& key, const string& value,
+    void parse_path_position(const rocksdb::Slice& key, const rocksdb::Slice& value,
                              int64_t& path_id, int64_t& path_pos, int64_t& node_id, Mapping& mapping);
-    void parse_mapping(const string& key, const string& value, int64_t& node_id, string& hash, Mapping& mapping);
-    void parse_alignment(const string& key, const string& value, int64_t& node_id, string& hash, Alignment& alignment);
+    void parse_mapping(const rocksdb::Slice& key, const rocksdb::Slice& value, int64_t& node_id, string& hash, Mapping& mapping);
+    void parse_alignment(const rocksdb::Slice& key, const rocksdb::Slice& value, int64_t& node_id, string& hash, Alignment& alignment);
 
     // for dumping graph state/ inspection
-    string entry_to_string(const string& key, const string& value);
-    string graph_entry_to_string(const string& key, const string& value);
-    string kmer_entry_to_string(const string& key, const string& value);
-    string position_entry_to_string(const string& key, const string& value);
-    string metadata_entry_to_string(const string& key, const string& value);
-    string node_path_to_string(const string& key, const string& value);
-    string path_position_to_string(const string& key, const string& value);
-    string mapping_entry_to_string(const string& key, const string& value);
-    string alignment_entry_to_string(const string& key, const string& value);
+    string entry_to_string(const rocksdb::Slice& key, const rocksdb::Slice& value);
+    string graph_entry_to_string(const rocksdb::Slice& key, const rocksdb::Slice& value);
+    string kmer_entry_to_string(const rocksdb::Slice& key, const rocksdb::Slice& value);
+    string position_entry_to_string(const rocksdb::Slice& key, const rocksdb::Slice& value);
+    string metadata_entry_to_string(const rocksdb::Slice& key, const rocksdb::Slice& value);
+    string node_path_to_string(const rocksdb::Slice& key, const rocksdb::Slice& value);
+    string path_position_to_string(const rocksdb::Slice& key, const rocksdb::Slice& value);
+    string mapping_entry_to_string(const rocksdb::Slice& key, const rocksdb::Slice& value);
+    string alignment_entry_to_string(const rocksdb::Slice& key, const rocksdb::Slice& value);
 
     // accessors, traversal, context
     void get_context(int64_t id, VG& graph);
     void expand_context(VG& graph, int steps);
     void get_range(int64_t from_id, int64_t to_id, VG& graph);
-    void for_graph_range(int64_t from_id, int64_t to_id, function<void(string&, string&)> lambda);
+    void for_graph_range(int64_t from_id, int64_t to_id, function<void(const rocksdb::Slice&, const rocksdb::Slice&)> lambda);
+    // adds the node, edge or path step of a graph entry to graph
+    void add_graph_entry(const rocksdb::Slice& key, const rocksdb::Slice& value, VG& graph);
     void get_connected_nodes(VG& graph);
     void get_edges_of(int64_t id, vector<Edge>& edges);
     void get_edges_from(int64_t from, vector<Edge>& edges);
@@ -210,14 +267,33 @@ public:
     void get_kmer_subgraph(const string& kmer, VG& graph);
     uint64_t approx_size_of_kmer_matches(const string& kmer);
     void approx_sizes_of_kmer_matches(const vector<string>& kmers, vector<uint64_t>& sizes);
-    void for_kmer_range(const string& kmer, function<void(string&, string&)> lambda);
+    void for_kmer_range(const string& kmer, function<void(const rocksdb::Slice&, const rocksdb::Slice&)> lambda);
     void get_kmer_positions(const string& kmer, map<int64_t, vector<int32_t> >& positions);
     void get_kmer_positions(const string& kmer, map<string, vector<pair<int64_t, int32_t> > >& positions);
-    void prune_kmers(int max_kb_on_disk);
+    // batched form, resolves all the kmers in one sorted sweep of a single iterator
+    void get_kmer_positions(const vector<string>& kmers, vector<map<int64_t, vector<int32_t> > >& positions);
+    // removes the kmers with more than max_hits entries
+    void prune_kmers(int max_hits);
 
     void remember_kmer_size(int size);
     set<int> stored_kmer_sizes(void);
+    // the inputs which have been indexed, by what was done with them (e.g. "graph")
+    // and a fingerprint of their contents, so that incremental updates can skip them
+    void remember_input(const string& stage, const string& file_name, const string& fingerprint);
+    // the fingerprint recorded for the input, or "" if it hasn't been indexed
+    string indexed_input(const string& stage, const string& file_name);
+    // if the kmers were stored as minimizers, the window used (0 otherwise)
+    void remember_minimizer_window(int window);
+    int stored_minimizer_window(void);
     void store_batch(map<string, string>& items);
+
+    // bulk loading through an external sort, which bypasses the memtable and compaction
+    // sorts the entries and writes them to a new run file next to the db, returning its name
+    string write_sorted_run(vector<pair<string, string> >& entries);
+    // merges the runs in key order, dropping entries with repeated keys, and removes them
+    void merge_sorted_runs(vector<string> runs, function<void(const string&, const string&)> lambda);
+    // merges the runs into sst files and ingests them into the column family of the key type
+    void ingest_sorted_runs(const vector<string>& runs, char key_type);
     //void store_positions(VG& graph, std::map<long, Node*>& node_path, std::map<long, Edge*>& edge_path);
 
     // once we have indexed the kmers, we can get the nodes and edges matching
@@ -231,11 +307,21 @@ public:
     string path_id_prefix(int64_t id);
     void put_path_id_to_name(int64_t id, const string& name);
     void put_path_name_to_id(int64_t id, const string& name);
+    // these use the path names and ids, which are read when the index is opened
+    // and kept up to date as paths are added, they return "" and 0 if there is no such path
+    // the maps aren't locked, so these must not run while new_path_id or store_paths
+    // adds paths from another thread
     string get_path_name(int64_t id);
     int64_t get_path_id(const string& name);
+    map<string, int64_t> path_ids;
+    map<int64_t, string> path_names;
     void load_paths(VG& graph);
     void store_paths(VG& graph); // of graph
     void store_path(VG& graph, Path& path); // path of graph
+    // the paths' entries are written in parallel, their positions come from the node lengths in graph
+    void store_paths(VG& graph, const vector<Path*>& paths);
+    // as above, counting the mappings written onto completed for the progress bar
+    void store_paths(VG& graph, const vector<Path*>& paths, int64_t& completed);
     map<string, int64_t> paths_by_id(void);
 
     // alignments and mappings
@@ -243,7 +329,7 @@ public:
     void for_each_alignment(function<void(const Alignment&)> lambda);
 
     // what table is the key in
-    char graph_key_type(string& key);
+    char graph_key_type(const rocksdb::Slice& key);
 
 };
 
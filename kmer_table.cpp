@@ -0,0 +1,301 @@
+#include "kmer_table.hpp"
+
+#include <algorithm>
+#include <fstream>
+#include <cstring>
+#include <cstdlib>
+#include <cstdio>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+namespace vg {
+
+using namespace std;
+
+static const char kmer_table_magic[8] = { 'v', 'g', 'k', 'm', 't', 'a', 'b', '1' };
+static const size_t kmer_table_header_size = 8 + 3 * sizeof(uint64_t);
+
+KmerTable::KmerTable(void)
+    : is_open(false)
+    , kmer_size(0)
+    , kmer_count(0)
+    , entry_count(0)
+    , mapped(NULL)
+    , mapped_size(0)
+    , kmers(NULL)
+    , offsets(NULL)
+    , node_ids(NULL)
+    , positions(NULL)
+{ }
+
+KmerTable::KmerTable(const string& name)
+    : KmerTable()
+{
+    open(name);
+}
+
+KmerTable::~KmerTable(void) {
+    if (is_open) {
+        close();
+    }
+}
+
+void KmerTable::open(const string& name) {
+    filename = name;
+    int fd = ::open(filename.c_str(), O_RDONLY);
+    if (fd < 0) {
+        cerr << "error:[vg::KmerTable] could not open " << filename << endl;
+        exit(1);
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < kmer_table_header_size) {
+        cerr << "error:[vg::KmerTable] " << filename << " is not a kmer table" << endl;
+        exit(1);
+    }
+    mapped_size = st.st_size;
+    mapped = mmap(NULL, mapped_size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (mapped == MAP_FAILED) {
+        cerr << "error:[vg::KmerTable] could not map " << filename << endl;
+        exit(1);
+    }
+
+    const char* data = (const char*) mapped;
+    if (memcmp(data, kmer_table_magic, sizeof(kmer_table_magic)) != 0) {
+        cerr << "error:[vg::KmerTable] " << filename << " is not a kmer table" << endl;
+        exit(1);
+    }
+    const uint64_t* header = (const uint64_t*) (data + sizeof(kmer_table_magic));
+    kmer_size = header[0];
+    kmer_count = header[1];
+    entry_count = header[2];
+
+    size_t expected_size = kmer_table_header_size
+        + kmer_count * sizeof(uint64_t)
+        + (kmer_count + 1) * sizeof(uint64_t)
+        + entry_count * (sizeof(int64_t) + sizeof(int32_t));
+    if (mapped_size < expected_size) {
+        cerr << "error:[vg::KmerTable] " << filename << " is truncated" << endl;
+        exit(1);
+    }
+
+    kmers = (const uint64_t*) (data + kmer_table_header_size);
+    offsets = kmers + kmer_count;
+    node_ids = (const int64_t*) (offsets + kmer_count + 1);
+    positions = (const int32_t*) (node_ids + entry_count);
+
+    // we will seek around the table at random
+    madvise(mapped, mapped_size, MADV_RANDOM);
+    is_open = true;
+}
+
+void KmerTable::close(void) {
+    munmap(mapped, mapped_size);
+    mapped = NULL;
+    mapped_size = 0;
+    kmers = NULL;
+    offsets = NULL;
+    node_ids = NULL;
+    positions = NULL;
+    is_open = false;
+}
+
+bool KmerTable::pack_kmer(const string& kmer, uint64_t& packed) {
+    if (kmer.size() > 32) return false;
+    packed = 0;
+    for (auto c : kmer) {
+        packed <<= 2;
+        switch (c) {
+        case 'A': case 'a': break;
+        case 'C': case 'c': packed |= 1; break;
+        case 'G': case 'g': packed |= 2; break;
+        case 'T': case 't': packed |= 3; break;
+        default: return false;
+        }
+    }
+    return true;
+}
+
+string KmerTable::unpack_kmer(uint64_t packed, int kmer_size) {
+    string kmer(kmer_size, 'A');
+    for (int i = kmer_size - 1; i >= 0; --i) {
+        kmer[i] = "ACGT"[packed & 3];
+        packed >>= 2;
+    }
+    return kmer;
+}
+
+// big-endian, so that the bytes compare in the order of the numbers
+static void put_big_endian(char* out, uint64_t value, int bytes) {
+    for (int i = bytes - 1; i >= 0; --i) {
+        out[i] = (char) (value & 0xff);
+        value >>= 8;
+    }
+}
+
+static uint64_t get_big_endian(const char* in, int bytes) {
+    uint64_t value = 0;
+    for (int i = 0; i < bytes; ++i) {
+        value = (value << 8) | (unsigned char) in[i];
+    }
+    return value;
+}
+
+static const size_t entry_key_size = sizeof(uint64_t) + sizeof(int64_t) + sizeof(int32_t);
+
+string KmerTable::entry_key(const KmerTableEntry& entry) {
+    string key(entry_key_size, '\0');
+    char* k = (char*) key.c_str();
+    put_big_endian(k, entry.kmer, sizeof(uint64_t));
+    // flip the sign bits so negative numbers sort before positive ones
+    put_big_endian(k + sizeof(uint64_t),
+                   (uint64_t) entry.node_id ^ ((uint64_t) 1 << 63), sizeof(int64_t));
+    put_big_endian(k + sizeof(uint64_t) + sizeof(int64_t),
+                   (uint32_t) entry.position ^ ((uint32_t) 1 << 31), sizeof(int32_t));
+    return key;
+}
+
+KmerTableEntry KmerTable::parse_entry_key(const string& key) {
+    const char* k = key.c_str();
+    KmerTableEntry entry;
+    entry.kmer = get_big_endian(k, sizeof(uint64_t));
+    entry.node_id = (int64_t) (get_big_endian(k + sizeof(uint64_t), sizeof(int64_t))
+                               ^ ((uint64_t) 1 << 63));
+    entry.position = (int32_t) ((uint32_t) get_big_endian(k + sizeof(uint64_t) + sizeof(int64_t),
+                                                          sizeof(int32_t))
+                                ^ ((uint32_t) 1 << 31));
+    return entry;
+}
+
+void KmerTable::write(const string& name, int kmer_size, vector<KmerTableEntry>& entries) {
+    std::sort(entries.begin(), entries.end());
+    entries.erase(std::unique(entries.begin(), entries.end()), entries.end());
+    write_sorted(name, kmer_size, [&entries](function<void(const KmerTableEntry&)> lambda) {
+            for (auto& e : entries) lambda(e);
+        });
+}
+
+void KmerTable::write_sorted(const string& name, int kmer_size,
+                             function<void(function<void(const KmerTableEntry&)>)> for_each_entry) {
+
+    if (kmer_size > 32) {
+        cerr << "error:[vg::KmerTable] kmer tables only support k <= 32" << endl;
+        exit(1);
+    }
+
+    // the header needs the counts, so each array goes to a file of its own
+    // while the entries stream past, and they are joined behind the header after
+    vector<string> section_names = { name + ".kmers.tmp", name + ".offsets.tmp",
+                                     name + ".node_ids.tmp", name + ".positions.tmp" };
+    vector<ofstream> sections(section_names.size());
+    for (size_t i = 0; i < sections.size(); ++i) {
+        sections[i].open(section_names[i].c_str(), ios::binary);
+        if (!sections[i]) {
+            cerr << "error:[vg::KmerTable] could not open " << section_names[i] << " for writing" << endl;
+            exit(1);
+        }
+    }
+    auto& kmers_out = sections[0];
+    auto& offsets_out = sections[1];
+    auto& node_ids_out = sections[2];
+    auto& positions_out = sections[3];
+
+    uint64_t kmer_count = 0;
+    uint64_t entry_count = 0;
+    uint64_t last_kmer = 0;
+    for_each_entry([&](const KmerTableEntry& e) {
+            if (kmer_count == 0 || e.kmer != last_kmer) {
+                kmers_out.write((const char*) &e.kmer, sizeof(uint64_t));
+                offsets_out.write((const char*) &entry_count, sizeof(uint64_t));
+                last_kmer = e.kmer;
+                ++kmer_count;
+            }
+            node_ids_out.write((const char*) &e.node_id, sizeof(int64_t));
+            positions_out.write((const char*) &e.position, sizeof(int32_t));
+            ++entry_count;
+        });
+    offsets_out.write((const char*) &entry_count, sizeof(uint64_t));
+
+    for (size_t i = 0; i < sections.size(); ++i) {
+        sections[i].close();
+        if (!sections[i]) {
+            cerr << "error:[vg::KmerTable] could not write " << section_names[i] << endl;
+            exit(1);
+        }
+    }
+
+    ofstream out(name.c_str(), ios::binary);
+    if (!out) {
+        cerr << "error:[vg::KmerTable] could not open " << name << " for writing" << endl;
+        exit(1);
+    }
+    uint64_t header[3] = { (uint64_t) kmer_size, kmer_count, entry_count };
+    out.write(kmer_table_magic, sizeof(kmer_table_magic));
+    out.write((const char*) header, sizeof(header));
+    vector<char> buf(1 << 20);
+    for (auto& section_name : section_names) {
+        ifstream in(section_name.c_str(), ios::binary);
+        while (in.read(buf.data(), buf.size()) || in.gcount() > 0) {
+            out.write(buf.data(), in.gcount());
+        }
+        in.close();
+        std::remove(section_name.c_str());
+    }
+    out.close();
+    if (!out) {
+        cerr << "error:[vg::KmerTable] could not write " << name << endl;
+        exit(1);
+    }
+}
+
+bool KmerTable::kmer_range(const string& kmer, uint64_t& first, uint64_t& last) {
+    uint64_t packed;
+    if ((int)kmer.size() > kmer_size || !pack_kmer(kmer, packed)) {
+        return false;
+    }
+    // shorter kmers cover every full-length kmer they prefix
+    int shift = 2 * (kmer_size - kmer.size());
+    uint64_t low = shift < 64 ? packed << shift : 0;
+    uint64_t high = shift < 64 ? low | ((((uint64_t)1) << shift) - 1) : ~((uint64_t)0);
+    first = std::lower_bound(kmers, kmers + kmer_count, low) - kmers;
+    last = std::upper_bound(kmers + first, kmers + kmer_count, high) - kmers;
+    return first < last;
+}
+
+uint64_t KmerTable::count_kmer_matches(const string& kmer) {
+    uint64_t first, last;
+    if (!kmer_range(kmer, first, last)) return 0;
+    return offsets[last] - offsets[first];
+}
+
+void KmerTable::for_kmer_range(const string& kmer, function<void(int64_t, int32_t)> lambda) {
+    uint64_t first, last;
+    if (!kmer_range(kmer, first, last)) return;
+    for (uint64_t i = offsets[first]; i < offsets[last]; ++i) {
+        lambda(node_ids[i], positions[i]);
+    }
+}
+
+void KmerTable::get_kmer_positions(const string& kmer, map<int64_t, vector<int32_t> >& kmer_positions) {
+    for_kmer_range(kmer, [&kmer_positions](int64_t id, int32_t pos) {
+            kmer_positions[id].push_back(pos);
+        });
+}
+
+bool KmerTable::get_kmer_positions(const string& kmer, map<int64_t, vector<int32_t> >& kmer_positions,
+                                   size_t max_nodes) {
+    uint64_t first, last;
+    if (!kmer_range(kmer, first, last)) return true;
+    for (uint64_t i = offsets[first]; i < offsets[last]; ++i) {
+        kmer_positions[node_ids[i]].push_back(positions[i]);
+        if (kmer_positions.size() > max_nodes) {
+            kmer_positions.clear();
+            return false;
+        }
+    }
+    return true;
+}
+
+}
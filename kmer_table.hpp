@@ -0,0 +1,107 @@
+#ifndef KMER_TABLE_H
+#define KMER_TABLE_H
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <map>
+#include <functional>
+#include <cstdint>
+
+namespace vg {
+
+using namespace std;
+
+/*
+
+  A flat, sorted table of kmer positions which is written once by vg index
+  and memory-mapped read-only by the mapper, so lookups hit the page cache
+  rather than decoding rocksdb blocks, and opening it costs nothing.
+
+  Kmers are 2-bit packed (A=0, C=1, G=2, T=3, first base in the high bits)
+  into a uint64_t, which limits k to 32. Because of the packing, all kmers
+  sharing a prefix are contiguous in the table, so kmers shorter than k can
+  be looked up as prefix ranges.
+
+  file layout, native byte order:
+  --------------------------------------------------------------
+  header     magic[8] "vgkmtab1", kmer_size, kmer_count, entry_count [uint64_t]
+  kmers      uint64_t[kmer_count]     sorted, unique packed kmers
+  offsets    uint64_t[kmer_count+1]   first entry of each kmer in the arrays below
+  node_ids   int64_t[entry_count]
+  positions  int32_t[entry_count]     position of the kmer in the node
+
+ */
+
+struct KmerTableEntry {
+    uint64_t kmer;
+    int64_t node_id;
+    int32_t position;
+    bool operator<(const KmerTableEntry& other) const {
+        if (kmer != other.kmer) return kmer < other.kmer;
+        if (node_id != other.node_id) return node_id < other.node_id;
+        return position < other.position;
+    }
+    bool operator==(const KmerTableEntry& other) const {
+        return kmer == other.kmer && node_id == other.node_id && position == other.position;
+    }
+};
+
+class KmerTable {
+
+public:
+
+    KmerTable(void);
+    KmerTable(const string& filename);
+    ~KmerTable(void);
+
+    void open(const string& filename);
+    void close(void);
+    bool is_open;
+
+    string filename;
+    int kmer_size;
+    uint64_t kmer_count;
+    uint64_t entry_count;
+
+    // sort and deduplicate the entries, then write them out as a table
+    static void write(const string& filename, int kmer_size, vector<KmerTableEntry>& entries);
+    // write a table from entries given in sorted order without repeats, streaming
+    // them through temporary files beside the table rather than holding them in memory
+    static void write_sorted(const string& filename, int kmer_size,
+                             function<void(function<void(const KmerTableEntry&)>)> for_each_entry);
+
+    // keys whose byte order is the entry order, to sort entries as strings
+    // (such as in the sorted runs of utility.hpp) and read them back
+    static string entry_key(const KmerTableEntry& entry);
+    static KmerTableEntry parse_entry_key(const string& key);
+
+    // packing, returns false if the kmer has non-ACGT characters or is too long
+    static bool pack_kmer(const string& kmer, uint64_t& packed);
+    static string unpack_kmer(uint64_t packed, int kmer_size);
+
+    // kmers shorter than kmer_size are treated as prefixes
+    uint64_t count_kmer_matches(const string& kmer);
+    void get_kmer_positions(const string& kmer, map<int64_t, vector<int32_t> >& positions);
+    // as above, but gives up, leaving positions empty and returning false,
+    // as soon as the kmer is found in more than max_nodes nodes
+    bool get_kmer_positions(const string& kmer, map<int64_t, vector<int32_t> >& positions, size_t max_nodes);
+    void for_kmer_range(const string& kmer, function<void(int64_t, int32_t)> lambda);
+
+private:
+
+    // the index range in kmers of all the kmers starting with the query
+    bool kmer_range(const string& kmer, uint64_t& first, uint64_t& last);
+
+    void* mapped;
+    size_t mapped_size;
+    const uint64_t* kmers;
+    const uint64_t* offsets;
+    const int64_t* node_ids;
+    const int32_t* positions;
+
+};
+
+}
+
+#endif
@@ -11,6 +11,8 @@
 #include "Variant.h"
 #include "Fasta.h"
 #include "stream.hpp"
+#include "gam_index.hpp"
+#include "compact_graph.hpp"
 #include "alignment.hpp"
 #include "convert.hpp"
 #include <google/protobuf/stubs/common.h>
@@ -1070,41 +1072,65 @@ int main_stats(int argc, char** argv) {
         }
     }
 
-    VG* graph;
+    // only the subgraphs need a full VG, the heads and tails are read into a compact graph,
+    // and the sizes and length need just one pass over the stream
+    VG* graph = NULL;
+    CompactGraph* compact = NULL;
     string file_name = argv[optind];
-    if (file_name == "-") {
-        graph = new VG(std::cin);
-    } else {
-        ifstream in;
+    ifstream in;
+    if (file_name != "-") {
         in.open(file_name.c_str());
-        graph = new VG(in);
+    }
+    istream& graph_in = (file_name == "-") ? std::cin : in;
+    int64_t node_count = 0;
+    int64_t edge_count = 0;
+    int64_t length = 0;
+    if (stats_subgraphs) {
+        graph = new VG(graph_in);
+        compact = new CompactGraph(*graph);
+    } else if (stats_heads || stats_tails) {
+        compact = new CompactGraph(graph_in);
+    } else {
+        VG::for_each_node_and_edge(graph_in,
+                                   [&node_count, &length](Node& node) {
+                                       ++node_count;
+                                       length += node.sequence().size();
+                                   },
+                                   [&edge_count](Edge& edge) {
+                                       ++edge_count;
+                                   });
+    }
+    if (compact) {
+        node_count = compact->node_count();
+        edge_count = compact->edge_count();
+        length = compact->total_length_of_nodes();
     }
 
     if (stats_size) {
-        cout << "nodes" << "\t" << graph->node_count() << endl
-             << "edges" << "\t" << graph->edge_count() << endl;
+        cout << "nodes" << "\t" << node_count << endl
+             << "edges" << "\t" << edge_count << endl;
     }
 
     if (stats_length) {
-        cout << "length" << "\t" << graph->total_length_of_nodes() << endl;
+        cout << "length" << "\t" << length << endl;
     }
 
     if (stats_heads) {
-        vector<Node*> heads;
-        graph->head_nodes(heads);
+        vector<int64_t> heads;
+        compact->head_nodes(heads);
         cout << "heads" << "\t";
-        for (vector<Node*>::iterator h = heads.begin(); h != heads.end(); ++h) {
-            cout << (*h)->id() << " ";
+        for (vector<int64_t>::iterator h = heads.begin(); h != heads.end(); ++h) {
+            cout << *h << " ";
         }
         cout << endl;
     }
 
     if (stats_tails) {
-        vector<Node*> tails;
-        graph->tail_nodes(tails);
+        vector<int64_t> tails;
+        compact->tail_nodes(tails);
         cout << "tails" << "\t";
-        for (vector<Node*>::iterator t = tails.begin(); t != tails.end(); ++t) {
-            cout << (*t)->id() << " ";
+        for (vector<int64_t>::iterator t = tails.begin(); t != tails.end(); ++t) {
+            cout << *t << " ";
         }
         cout << endl;
     }
@@ -1125,6 +1151,7 @@ int main_stats(int argc, char** argv) {
         }
     }
 
+    delete compact;
     delete graph;
 
     return 0;
@@ -1263,6 +1290,8 @@ void help_find(char** argv) {
          << "    -p, --path TARGET      find the node(s) in the specified path range TARGET=path[:pos1[-pos2]]" << endl
          << "    -P, --position-in PATH find the position of the node (specified by -n) in the given path" << endl
          << "    -r, --node-range N:M   get nodes from N to M" << endl
+         << "    -G, --gam FILE         with -n or -r, write the alignments in FILE touching those nodes" << endl
+         << "                           using the index FILE.gai (see vg index -G), a db is not needed" << endl
         //<< "    -a, --alignments       write all stored alignments in sorted order (in GAM)" << endl
         //<< "    -m, --mappings         write stored mappings in sorted order (in json)" << endl
          << "    -d, --db-name DIR      use this db (defaults to <graph>.index/)" << endl;
@@ -1291,6 +1320,7 @@ int main_find(int argc, char** argv) {
     string range;
     bool get_alignments = false;
     bool get_mappings = false;
+    string gam_file;
 
     int c;
     optind = 2; // force optind past command positional argument
@@ -1315,11 +1345,12 @@ int main_find(int argc, char** argv) {
                 {"node-range", required_argument, 0, 'r'},
                 {"alignments", no_argument, 0, 'a'},
                 {"mappings", no_argument, 0, 'm'},
+                {"gam", required_argument, 0, 'G'},
                 {0, 0, 0, 0}
             };
 
         int option_index = 0;
-        c = getopt_long (argc, argv, "d:n:f:t:o:k:hc:s:z:j:CTp:P:r:am",
+        c = getopt_long (argc, argv, "d:n:f:t:o:k:hc:s:z:j:CTp:P:r:amG:",
                          long_options, &option_index);
         
         // Detect the end of the options.
@@ -1392,6 +1423,10 @@ int main_find(int argc, char** argv) {
             get_mappings = true;
             break;
 
+        case 'G':
+            gam_file = optarg;
+            break;
+
         case 'o':
             output_format = optarg;
             break;
@@ -1407,6 +1442,38 @@ int main_find(int argc, char** argv) {
         }
     }
 
+    if (!gam_file.empty()) {
+        vector<pair<int64_t, int64_t> > ranges;
+        for (auto node_id : node_ids) {
+            ranges.push_back(make_pair(node_id, node_id));
+        }
+        if (!range.empty()) {
+            int64_t id_start=0, id_end=0;
+            vector<string> parts = split_delims(range, ":");
+            if (parts.size() == 1) {
+                cerr << "[vg find] error, format of range must be \"N:M\" where start id is N and end id is M, got " << range << endl;
+                exit(1);
+            }
+            convert(parts.front(), id_start);
+            convert(parts.back(), id_end);
+            ranges.push_back(make_pair(id_start, id_end));
+        }
+        if (ranges.empty()) {
+            cerr << "error:[vg find] a node (-n) or node range (-r) is required to query a GAM" << endl;
+            return 1;
+        }
+        GAMIndex gai;
+        gai.load(gam_file + ".gai");
+        ifstream in(gam_file.c_str(), ios::binary);
+        vector<Alignment> buffer;
+        gai.for_alignment_in_ranges(in, ranges, [&buffer](Alignment& aln) {
+                buffer.push_back(aln);
+                stream::write_buffered(cout, buffer, 1000);
+            });
+        stream::write_buffered(cout, buffer, 0);
+        return 0;
+    }
+
     if (optind < argc) {
         string file_name = argv[optind];
         if (file_name == "-") {
@@ -1574,10 +1641,15 @@ void help_index(char** argv) {
          << "    -s, --store-graph      store graph (do this first to build db!)" << endl
          << "    -m, --store-mappings   input is .gam format, store the mappings in alignments by node" << endl
          << "    -a, --store-alignments input is .gam format, store the alignments by node" << endl
+         << "    -G, --gam-index        input is .gam format, write a random-access index <gam>.gai by node id" << endl
          << "    -k, --kmer-size N      index kmers of size N in the graph" << endl
          << "    -e, --edge-max N       cross no more than N edges when determining k-paths" << endl
          << "    -j, --kmer-stride N    step distance between succesive kmers in paths (default 1)" << endl
-         << "    -P, --prune KB         remove kmer entries which use more than KB kilobytes" << endl
+         << "    -w, --minimizers W     only index kmers which are the minimizer of some window of W kmers" << endl
+         << "    -K, --pack-kmers       store kmers 2-bit packed, shrinking their keys (ACGT only, k <= 255)" << endl
+         << "    -T, --kmer-table       write the kmers (-k) to a memory-mappable table <db>.kmers" << endl
+         << "                           rather than to the db (k <= 32)" << endl
+         << "    -P, --prune N          remove kmers which occur more than N times in the graph" << endl
          << "    -D, --dump             print the contents of the db to stdout" << endl
          << "    -M, --metadata         describe aspects of the db stored in metadata" << endl
          << "    -L, --path-layout      describes the path layout of the graph" << endl
@@ -1586,6 +1658,10 @@ void help_index(char** argv) {
          << "                           (this is required if you are using multiple graphs files" << endl
         //<< "    -b, --tmp-db-base S    use this base name for temporary indexes" << endl
          << "    -C, --compact          compact the index into a single level (improves performance)" << endl
+         << "    -I, --incremental      only store (-s) or index the kmers (-k) of graphs which an earlier -I run" << endl
+         << "                           hasn't, along with the kmers spanning into stored graphs; this only adds" << endl
+         << "                           new graphs, which must not reuse stored node ids, and it is an error" << endl
+         << "                           to give a graph which has changed since it was indexed" << endl
          << "    -t, --threads N        number of threads to use" << endl
          << "    -p, --progress         show progress" << endl;
 }
@@ -1601,7 +1677,7 @@ int main_index(int argc, char** argv) {
     int kmer_size = 0;
     int edge_max = 0;
     int kmer_stride = 1;
-    int prune_kb = -1;
+    int prune_hits = -1;
     bool store_graph = false;
     bool dump_index = false;
     bool describe_index = false;
@@ -1611,6 +1687,11 @@ int main_index(int argc, char** argv) {
     bool store_alignments = false;
     bool store_mappings = false;
     bool compact = false;
+    bool kmer_table = false;
+    int minimizer_window = 0;
+    bool gam_index = false;
+    bool pack_kmers = false;
+    bool incremental = false;
 
     int c;
     optind = 2; // force optind past command positional argument
@@ -1620,11 +1701,15 @@ int main_index(int argc, char** argv) {
                 //{"verbose", no_argument,       &verbose_flag, 1},
                 {"db-name", required_argument, 0, 'd'},
                 {"kmer-size", required_argument, 0, 'k'},
+                {"kmer-table", no_argument, 0, 'T'},
+                {"minimizers", required_argument, 0, 'w'},
+                {"pack-kmers", no_argument, 0, 'K'},
                 {"edge-max", required_argument, 0, 'e'},
                 {"kmer-stride", required_argument, 0, 'j'},
                 {"store-graph", no_argument, 0, 's'},
                 {"store-alignments", no_argument, 0, 'a'},
                 {"store-mappings", no_argument, 0, 'm'},
+                {"gam-index", no_argument, 0, 'G'},
                 {"dump", no_argument, 0, 'D'},
                 {"metadata", no_argument, 0, 'M'},
                 {"set-kmer", no_argument, 0, 'S'},
@@ -1633,11 +1718,12 @@ int main_index(int argc, char** argv) {
                 {"prune",  required_argument, 0, 'P'},
                 {"path-layout", no_argument, 0, 'L'},
                 {"compact", no_argument, 0, 'C'},
+                {"incremental", no_argument, 0, 'I'},
                 {0, 0, 0, 0}
             };
 
         int option_index = 0;
-        c = getopt_long (argc, argv, "d:k:j:pDshMt:b:e:SP:LmaC",
+        c = getopt_long (argc, argv, "d:k:j:pDshMt:b:e:SP:LmaCTw:GKI",
                          long_options, &option_index);
         
         // Detect the end of the options.
@@ -1651,13 +1737,25 @@ int main_index(int argc, char** argv) {
             break;
 
         case 'P':
-            prune_kb = atoi(optarg);
+            prune_hits = atoi(optarg);
             break;
 
         case 'k':
             kmer_size = atoi(optarg);
             break;
 
+        case 'T':
+            kmer_table = true;
+            break;
+
+        case 'w':
+            minimizer_window = atoi(optarg);
+            break;
+
+        case 'K':
+            pack_kmers = true;
+            break;
+
         case 'e':
             edge_max = atoi(optarg);
             break;
@@ -1698,10 +1796,18 @@ int main_index(int argc, char** argv) {
             store_mappings = true;
             break;
 
+        case 'G':
+            gam_index = true;
+            break;
+
         case 'C':
             compact = true;
             break;
 
+        case 'I':
+            incremental = true;
+            break;
+
         case 't':
             omp_set_num_threads(atoi(optarg));
             break;
@@ -1725,6 +1831,35 @@ int main_index(int argc, char** argv) {
         file_names.push_back(file_name);
     }
 
+    if (kmer_table && kmer_size == 0) {
+        cerr << "error:[vg index] a kmer table (-T) requires a kmer size (-k)" << endl;
+        help_index(argv);
+        return 1;
+    }
+
+    if (kmer_table && kmer_size > 32) {
+        cerr << "error:[vg index] kmer tables only support kmers up to 32bp" << endl;
+        return 1;
+    }
+
+    if (gam_index) {
+        for (auto& file_name : file_names) {
+            if (file_name == "-") {
+                cerr << "error:[vg index] GAM indexing requires a file, not stdin" << endl;
+                return 1;
+            }
+            if (show_progress) {
+                cerr << "indexing alignments in " << file_name << endl;
+            }
+            ifstream in(file_name.c_str(), ios::binary);
+            GAMIndex gai;
+            gai.index_gam(in);
+            gai.save(file_name + ".gai");
+        }
+        // the GAM index doesn't use the db
+        if (db_name.empty()) return 0;
+    }
+
     if (db_name.empty()) {
         if (file_names.size() > 1) {
             cerr << "error:[vg index] working on multiple graphs and no db name (-d) given, exiting" << endl;
@@ -1738,6 +1873,7 @@ int main_index(int argc, char** argv) {
     }
 
     Index index;
+    index.packed_kmers = pack_kmers;
 
     if (compact) {
         index.open_for_write(db_name);
@@ -1750,6 +1886,9 @@ int main_index(int argc, char** argv) {
         index.open_for_write(db_name);
         VGset graphs(file_names);
         graphs.show_progress = show_progress;
+        if (incremental) {
+            graphs.skip_indexed(index, "graph");
+        }
         graphs.store_in_index(index);
         //index.flush();
         //index.close();
@@ -1757,6 +1896,9 @@ int main_index(int argc, char** argv) {
         // this requires the index to be queryable
         //index.open_for_write(db_name);
         graphs.store_paths_in_index(index);
+        if (incremental) {
+            graphs.remember_indexed(index, "graph");
+        }
         index.compact();
         index.flush();
         index.close();
@@ -1801,26 +1943,35 @@ int main_index(int argc, char** argv) {
         index.close();
     }
 
-    if (kmer_size != 0 && file_names.size() > 0) {
+    if (kmer_table && kmer_size != 0 && file_names.size() > 0) {
+        VGset graphs(file_names);
+        graphs.show_progress = show_progress;
+        graphs.write_kmer_table(db_name + ".kmers", kmer_size, edge_max, kmer_stride, minimizer_window);
+    } else if (kmer_size != 0 && file_names.size() > 0) {
         index.open_for_bulk_load(db_name);
         VGset graphs(file_names);
         graphs.show_progress = show_progress;
-        graphs.index_kmers(index, kmer_size, edge_max, kmer_stride);
-        index.flush();
-        index.close();
-        // forces compaction
-        index.open_for_write(db_name);
+        stringstream stage;
+        stage << "kmers k=" << kmer_size << " e=" << edge_max << " j=" << kmer_stride << " w=" << minimizer_window
+              << (pack_kmers ? " packed" : "");
+        if (incremental) {
+            graphs.skip_indexed(index, stage.str());
+        }
+        // the kmers are ingested already sorted, so they need no compaction
+        graphs.index_kmers(index, kmer_size, edge_max, kmer_stride, minimizer_window, incremental);
+        if (incremental) {
+            graphs.remember_indexed(index, stage.str());
+        }
         index.flush();
-        index.compact();
         index.close();
     }
 
-    if (prune_kb >= 0) {
+    if (prune_hits >= 0) {
         if (show_progress) {
-            cerr << "pruning kmers > " << prune_kb << " on disk from " << db_name << endl;
+            cerr << "pruning kmers with > " << prune_hits << " hits from " << db_name << endl;
         }
         index.open_for_write(db_name);
-        index.prune_kmers(prune_kb);
+        index.prune_kmers(prune_hits);
         index.compact();
         index.close();
     }
@@ -1870,13 +2021,14 @@ void help_align(char** argv) {
     cerr << "usage: " << argv[0] << " align [options] <graph.vg> >alignments.vga" << endl
          << "options:" << endl
          << "    -s, --sequence STR    align a string to the graph in graph.vg using partial order alignment" << endl
+         << "                          may be given more than once, the graph is prepared for alignment once" << endl
         //<< "    -p, --print-cigar     output graph cigar for alignments" << endl
          << "    -j, --json            output alignments in JSON format (default)" << endl;
 }
 
 int main_align(int argc, char** argv) {
 
-    string seq;
+    vector<string> seqs;
 
     if (argc == 2) {
         help_align(argv);
@@ -1908,7 +2060,7 @@ int main_align(int argc, char** argv) {
         switch (c)
         {
         case 's':
-            seq = optarg;
+            seqs.push_back(optarg);
             break;
 
             /*
@@ -1943,11 +2095,18 @@ int main_align(int argc, char** argv) {
         graph = new VG(in);
     }
 
-    Alignment alignment = graph->align(seq);
+    // build the gssw graph once and align every sequence against it
+    graph->create_alignable_graph();
+
+    for (auto& seq : seqs) {
+        Alignment alignment = graph->align(seq);
 
-    char *json2 = pb2json(alignment);
-    cout<<json2<<endl;
-    free(json2);
+        char *json2 = pb2json(alignment);
+        cout<<json2<<endl;
+        free(json2);
+    }
+
+    graph->destroy_alignable_graph();
 
     delete graph;
 
@@ -1974,6 +2133,12 @@ void help_map(char** argv) {
          << "    -S, --sens-step N     decrease kmer size by N bp until alignment succeeds (default 5)" << endl
          << "    -c, --clusters N      use at most the largest N ordered clusters of the kmer graph for alignment" << endl
          << "    -m, --hit-max N       ignore kmers who have >N hits in our index (default 100)" << endl
+         << "    -T, --kmer-table      look up kmers in the memory-mapped table <db>.kmers (see vg index -T)" << endl
+         << "    -w, --minimizers W    seed with the minimizers of each window of W kmers (default: from index)" << endl
+         << "    -C, --cache-size N    keep up to N recently used subgraphs per thread (default 256, 0 to disable" << endl
+         << "                          this and the cache of mate rescue graphs)" << endl
+         << "    -W, --band-width N    first align only to nodes within N bp of the seed anchors (default 0, disabled)" << endl
+         << "    -Z, --compress N      compress the output at zlib level N, 0 for none (default 6)" << endl
          << "    -t, --threads N       number of threads to use" << endl
          << "    -F, --prefer-forward  if the forward alignment of the read works, accept it" << endl
          << "    -X, --score-per-bp N  accept forward if the alignment score per base is > N and -F is set" << endl
@@ -2008,6 +2173,11 @@ int main_map(int argc, char** argv) {
     bool interleaved_fastq = false;
     int pair_window = 64; // ~11bp/node
     bool try_both_mates_first = false;
+    bool use_kmer_table = false;
+    int minimizer_window = 0;
+    int cache_size = -1;
+    int band_width = 0;
+    int compress_level = Z_DEFAULT_COMPRESSION;
 
     int c;
     optind = 2; // force optind past command positional argument
@@ -2025,6 +2195,11 @@ int main_map(int argc, char** argv) {
                 {"sample", required_argument, 0, 'N'},
                 {"read-group", required_argument, 0, 'R'},
                 {"hit-max", required_argument, 0, 'm'},
+                {"kmer-table", no_argument, 0, 'T'},
+                {"minimizers", required_argument, 0, 'w'},
+                {"cache-size", required_argument, 0, 'C'},
+                {"band-width", required_argument, 0, 'W'},
+                {"compress", required_argument, 0, 'Z'},
                 {"threads", required_argument, 0, 't'},
                 {"prefer-forward", no_argument, 0, 'F'},
                 {"score-per-bp", required_argument, 0, 'X'},
@@ -2039,7 +2214,7 @@ int main_map(int argc, char** argv) {
             };
 
         int option_index = 0;
-        c = getopt_long (argc, argv, "s:j:hd:c:r:m:k:t:DX:FS:Jb:R:N:if:p:",
+        c = getopt_long (argc, argv, "s:j:hd:c:r:m:k:t:DX:FS:Jb:R:N:if:p:Tw:C:W:Z:",
                          long_options, &option_index);
         
         /* Detect the end of the options. */
@@ -2076,6 +2251,30 @@ int main_map(int argc, char** argv) {
             hit_max = atoi(optarg);
             break;
 
+        case 'T':
+            use_kmer_table = true;
+            break;
+
+        case 'w':
+            minimizer_window = atoi(optarg);
+            break;
+
+        case 'C':
+            cache_size = atoi(optarg);
+            break;
+
+        case 'W':
+            band_width = atoi(optarg);
+            break;
+
+        case 'Z':
+            compress_level = atoi(optarg);
+            if (compress_level < 0 || compress_level > 9) {
+                cerr << "error:[vg map] compression level must be between 0 and 9" << endl;
+                return 1;
+            }
+            break;
+
         case 'r':
             read_file = optarg;
             break;
@@ -2167,14 +2366,26 @@ int main_map(int argc, char** argv) {
     Index idx;
     idx.open_read_only(db_name);
 
+    // shared between the mappers, it is only ever read
+    KmerTable* kmer_table = NULL;
+    if (use_kmer_table) {
+        kmer_table = new KmerTable(db_name + ".kmers");
+    }
+
     for (int i = 0; i < thread_count; ++i) {
-        Mapper* m = new Mapper(&idx);
+        Mapper* m = new Mapper(&idx, kmer_table);
         m->best_clusters = best_clusters;
         m->hit_max = hit_max;
         m->debug = debug;
         if (score_per_bp) m->target_score_per_bp = score_per_bp;
         if (sens_step) m->kmer_sensitivity_step = sens_step;
         m->prefer_forward = prefer_forward;
+        if (minimizer_window) m->minimizer_window = minimizer_window;
+        if (cache_size >= 0) {
+            m->range_cache_size = cache_size;
+            m->rescue_cache_size = min(cache_size, m->rescue_cache_size);
+        }
+        m->band_width = band_width;
         mapper[i] = m;
     }
 
@@ -2192,7 +2403,7 @@ int main_map(int argc, char** argv) {
                 [&alignment] (uint64_t n) {
                 return alignment;
             };
-            stream::write(cout, 1, lambda);
+            stream::write(cout, 1, lambda, compress_level);
         }
     }
 
@@ -2221,7 +2432,7 @@ int main_map(int argc, char** argv) {
                     } else {
                         auto& output_buf = output_buffer[tid];
                         output_buf.push_back(alignment);
-                        stream::write_buffered(cout, output_buf, 1000);
+                        stream::write_buffered(cout, output_buf, 1000, compress_level);
                     }
                 }
             }
@@ -2233,6 +2444,7 @@ int main_map(int argc, char** argv) {
             [&mapper,
              &output_buffer,
              &output_json,
+             &compress_level,
              &kmer_size,
              &kmer_stride]
             (Alignment& alignment) {
@@ -2246,7 +2458,7 @@ int main_map(int argc, char** argv) {
             } else {
                 auto& output_buf = output_buffer[tid];
                 output_buf.push_back(alignment);
-                stream::write_buffered(cout, output_buf, 1000);
+                stream::write_buffered(cout, output_buf, 1000, compress_level);
             }
         };
         // run
@@ -2260,6 +2472,7 @@ int main_map(int argc, char** argv) {
                 [&mapper,
                  &output_buffer,
                  &output_json,
+                 &compress_level,
                  &kmer_size,
                  &kmer_stride,
                  &pair_window]
@@ -2276,7 +2489,7 @@ int main_map(int argc, char** argv) {
                     auto& output_buf = output_buffer[tid];
                     output_buf.push_back(alnp.first);
                     output_buf.push_back(alnp.second);
-                    stream::write_buffered(cout, output_buf, 1000);
+                    stream::write_buffered(cout, output_buf, 1000, compress_level);
                 }
             };
             fastq_paired_interleaved_for_each_parallel(fastq1, lambda);
@@ -2286,6 +2499,7 @@ int main_map(int argc, char** argv) {
                 [&mapper,
                  &output_buffer,
                  &output_json,
+                 &compress_level,
                  &kmer_size,
                  &kmer_stride]
                 (Alignment& alignment) {
@@ -2299,7 +2513,7 @@ int main_map(int argc, char** argv) {
                 } else {
                     auto& output_buf = output_buffer[tid];
                     output_buf.push_back(alignment);
-                    stream::write_buffered(cout, output_buf, 1000);
+                    stream::write_buffered(cout, output_buf, 1000, compress_level);
                 }
             };
             fastq_unpaired_for_each_parallel(fastq1, lambda);
@@ -2309,6 +2523,7 @@ int main_map(int argc, char** argv) {
                 [&mapper,
                  &output_buffer,
                  &output_json,
+                 &compress_level,
                  &kmer_size,
                  &kmer_stride,
                  &pair_window]
@@ -2325,7 +2540,7 @@ int main_map(int argc, char** argv) {
                     auto& output_buf = output_buffer[tid];
                     output_buf.push_back(alnp.first);
                     output_buf.push_back(alnp.second);
-                    stream::write_buffered(cout, output_buf, 1000);
+                    stream::write_buffered(cout, output_buf, 1000, compress_level);
                 }
             };
             fastq_paired_two_files_for_each_parallel(fastq1, fastq2, lambda);
@@ -2337,9 +2552,10 @@ int main_map(int argc, char** argv) {
         delete mapper[i];
         auto& output_buf = output_buffer[i];
         if (!output_json) {
-            stream::write_buffered(cout, output_buf, 0);
+            stream::write_buffered(cout, output_buf, 0, compress_level);
         }
     }
+    delete kmer_table;
 
     cout.flush();
 
@@ -2478,12 +2694,14 @@ int main_view(int argc, char** argv) {
     }
     string file_name = argv[optind];
     if (input_type == "vg") {
+        // json is written straight from the protobuf graph, so it needs no indexes
+        bool light = output_type == "json";
         if (file_name == "-") {
-            graph = new VG(std::cin);
+            graph = new VG(std::cin, false, light);
         } else {
             ifstream in;
             in.open(file_name.c_str());
-            graph = new VG(in);
+            graph = new VG(in, false, light);
         }
     } else if (input_type == "gfa") {
         if (file_name == "-") {
@@ -2,8 +2,9 @@
 
 namespace vg {
 
-Mapper::Mapper(Index* idex)
+Mapper::Mapper(Index* idex, KmerTable* table)
     : index(idex)
+    , kmer_table(table)
     , best_clusters(0)
     , hit_max(100)
     , hit_size_threshold(0)
@@ -16,9 +17,23 @@ Mapper::Mapper(Index* idex)
     , softclip_threshold(0)
     , prefer_forward(false)
     , target_score_per_bp(1.5)
+    , minimizer_window(0)
+    , band_width(0)
+    , range_cache(NULL)
+    , range_cache_size(256)
+    , range_cache_hits(0)
+    , range_cache_misses(0)
+    , rescue_cache(NULL)
+    , rescue_cache_size(16)
     , debug(false)
 {
-    kmer_sizes = index->stored_kmer_sizes();
+    if (kmer_table) {
+        kmer_sizes.insert(kmer_table->kmer_size);
+    } else {
+        kmer_sizes = index->stored_kmer_sizes();
+        // an index of minimizers can only be seeded with minimizers
+        minimizer_window = index->stored_minimizer_window();
+    }
     if (kmer_sizes.empty()) {
         cerr << "error:[vg::Mapper] the index (" 
              << index->name << ") does not include kmers" << endl;
@@ -26,8 +41,75 @@ Mapper::Mapper(Index* idex)
     }
 }
 
+// a mapper without an index, with the same settings as above
+Mapper::Mapper(void)
+    : index(NULL)
+    , kmer_table(NULL)
+    , debug(false)
+    , best_clusters(0)
+    , hit_max(100)
+    , hit_size_threshold(0)
+    , kmer_min(18)
+    , kmer_threshold(1)
+    , kmer_sensitivity_step(3)
+    , thread_extension(1)
+    , thread_extension_max(80)
+    , max_attempts(3)
+    , softclip_threshold(0)
+    , target_score_per_bp(1.5)
+    , prefer_forward(false)
+    , minimizer_window(0)
+    , band_width(0)
+    , range_cache(NULL)
+    , range_cache_size(256)
+    , range_cache_hits(0)
+    , range_cache_misses(0)
+    , rescue_cache(NULL)
+    , rescue_cache_size(16)
+{
+}
+
 Mapper::~Mapper(void) {
-    // noop
+    if (debug && range_cache) {
+        cerr << "range cache hits " << range_cache_hits
+             << " misses " << range_cache_misses << endl;
+    }
+    delete range_cache;
+    delete rescue_cache;
+}
+
+// the key of a node id range in our caches
+static string range_key(int64_t from_id, int64_t to_id) {
+    string key(2*sizeof(int64_t), '\0');
+    memcpy((char*)key.c_str(), &from_id, sizeof(int64_t));
+    memcpy((char*)key.c_str()+sizeof(int64_t), &to_id, sizeof(int64_t));
+    return key;
+}
+
+void Mapper::get_cached_range(int64_t from_id, int64_t to_id, VG& graph) {
+    if (range_cache_size == 0) {
+        index->get_range(from_id, to_id, graph);
+        return;
+    }
+    if (range_cache == NULL) {
+        range_cache = new LRUCache<string, shared_ptr<Graph> >(range_cache_size);
+    }
+    string key = range_key(from_id, to_id);
+    pair<shared_ptr<Graph>, bool> cached = range_cache->retrieve(key);
+    if (cached.second) {
+        ++range_cache_hits;
+        graph.extend(*cached.first);
+        return;
+    }
+    ++range_cache_misses;
+    VG range;
+    index->get_range(from_id, to_id, range);
+    // store the paths in the graph so they come back with it
+    shared_ptr<Graph> g(new Graph);
+    g->Swap(&range.graph);
+    range.paths.to_graph(*g);
+    range_cache->put(key, g);
+    graph.extend(*g);
 }
 
 Alignment Mapper::align(string& seq, int kmer_size, int stride) {
@@ -47,12 +129,29 @@ void Mapper::align_mate_in_window(Alignment& read1, Alignment& read2, int pair_w
     // just use the whole "window" for now
     int64_t first = max((int64_t)0, idf - pair_window);
     int64_t last = idl + (int64_t) pair_window;
-    VG* graph = new VG;
-    index->get_range(first, last, *graph);
-    graph->remove_orphan_edges();
     read2.clear_path();
+    if (rescue_cache_size == 0) {
+        VG graph;
+        get_cached_range(first, last, graph);
+        graph.remove_orphan_edges();
+        graph.align(read2);
+        return;
+    }
+    if (rescue_cache == NULL) {
+        rescue_cache = new LRUCache<string, shared_ptr<VG> >(rescue_cache_size);
+    }
+    string key = range_key(first, last);
+    pair<shared_ptr<VG>, bool> cached = rescue_cache->retrieve(key);
+    shared_ptr<VG> graph = cached.first;
+    if (!cached.second) {
+        graph.reset(new VG);
+        get_cached_range(first, last, *graph);
+        graph->remove_orphan_edges();
+        // join the heads, sort, and build the gssw graph once for the window
+        graph->create_alignable_graph();
+        rescue_cache->put(key, graph);
+    }
     graph->align(read2);
-    delete graph;
 }
 
 pair<Alignment, Alignment> Mapper::align_paired(Alignment& read1, Alignment& read2, int kmer_size, int stride, int pair_window) {
@@ -151,10 +250,29 @@ Alignment Mapper::align(Alignment& aln, int kmer_size, int stride) {
 
     while (alignment_f.score() == 0 && alignment_r.score() == 0 && attempt < max_attempts) {
 
+        // seed both strands in a single batched pass over the index
+        // unless we may be able to skip the reverse strand entirely
+        vector<int> offsets_f;
+        vector<int> offsets_r;
+        vector<string> kmers_f = seed_kmers(alignment_f.sequence(), kmer_size, stride, offsets_f);
+        vector<string> kmers_r = seed_kmers(alignment_r.sequence(), kmer_size, stride, offsets_r);
+        vector<map<int64_t, vector<int32_t> > > positions_f;
+        vector<map<int64_t, vector<int32_t> > > positions_r;
+        if (prefer_forward) {
+            find_kmer_positions(kmers_f, positions_f);
+        } else {
+            vector<string> kmers = kmers_f;
+            kmers.insert(kmers.end(), kmers_r.begin(), kmers_r.end());
+            find_kmer_positions(kmers, positions_f);
+            positions_r.assign(make_move_iterator(positions_f.begin() + kmers_f.size()),
+                               make_move_iterator(positions_f.end()));
+            positions_f.resize(kmers_f.size());
+        }
+
         {
             std::chrono::time_point<std::chrono::system_clock> start, end;
             if (debug) start = std::chrono::system_clock::now();
-            align_threaded(alignment_f, kmer_count_f, kmer_size, stride, attempt);
+            align_threaded(alignment_f, kmers_f, offsets_f, positions_f, kmer_count_f, kmer_size, stride, attempt);
             if (debug) {
                 end = std::chrono::system_clock::now();
                 std::chrono::duration<double> elapsed_seconds = end-start;
@@ -166,7 +284,8 @@ Alignment Mapper::align(Alignment& aln, int kmer_size, int stride) {
         {
             std::chrono::time_point<std::chrono::system_clock> start, end;
             if (debug) start = std::chrono::system_clock::now();
-            align_threaded(alignment_r, kmer_count_r, kmer_size, stride, attempt);
+            if (prefer_forward) find_kmer_positions(kmers_r, positions_r);
+            align_threaded(alignment_r, kmers_r, offsets_r, positions_r, kmer_count_r, kmer_size, stride, attempt);
             if (debug) {
                 end = std::chrono::system_clock::now();
                 std::chrono::duration<double> elapsed_seconds = end-start;
@@ -197,210 +316,155 @@ Alignment Mapper::align(Alignment& aln, int kmer_size, int stride) {
     }
 }
 
-Alignment& Mapper::align_threaded(Alignment& alignment, int& kmer_count, int kmer_size, int stride, int attempt) {
+vector<string> Mapper::seed_kmers(const string& seq, int kmer_size, int stride, vector<int>& offsets) {
+    if (minimizer_window) {
+        offsets = minimizer_kmer_offsets(seq, kmer_size, minimizer_window);
+    } else {
+        offsets = balanced_kmer_offsets(seq, kmer_size, stride);
+    }
+    vector<string> kmers;
+    kmers.reserve(offsets.size());
+    for (auto i : offsets) {
+        kmers.push_back(seq.substr(i, kmer_size));
+    }
+    return kmers;
+}
 
-    // parameters, some of which should probably be modifiable
-    // TODO -- move to Mapper object
+void Mapper::find_kmer_positions(const vector<string>& kmers,
+                                 vector<map<int64_t, vector<int32_t> > >& positions) {
 
     if (index == NULL) {
         cerr << "error:[vg::Mapper] no index loaded, cannot map alignment!" << endl;
         exit(1);
     }
 
-    const string& sequence = alignment.sequence();
-    auto kmers = balanced_kmers(sequence, kmer_size, stride);
+    positions.clear();
+    positions.resize(kmers.size());
+
+    if (kmer_table) {
+        for (size_t i = 0; i < kmers.size(); ++i) {
+            if (debug) cerr << kmers[i] << "\t" << kmer_table->count_kmer_matches(kmers[i]) << endl;
+            // kmers in more than hit_max nodes are uninformative, and the table
+            // stops building their positions as soon as it sees that many nodes
+            kmer_table->get_kmer_positions(kmers[i], positions[i], hit_max);
+        }
+        return;
+    }
 
-    //vector<uint64_t> sizes;
-    //index->approx_sizes_of_kmer_matches(kmers, sizes);
+    vector<uint64_t> sizes;
+    index->approx_sizes_of_kmer_matches(kmers, sizes);
 
-    vector<map<int64_t, vector<int32_t> > > positions(kmers.size());
-    int i = 0;
-    for (auto& k : kmers) {
-        uint64_t approx_matches = index->approx_size_of_kmer_matches(k);
-        if (debug) cerr << k << "\t" << approx_matches << endl;
+    vector<string> informative;
+    vector<size_t> informative_idx;
+    for (size_t i = 0; i < kmers.size(); ++i) {
+        if (debug) cerr << kmers[i] << "\t" << sizes[i] << endl;
         // if we have more than one block worth of kmers on disk, consider this kmer non-informative
         // we can do multiple mapping by relaxing this
-        if (approx_matches > hit_size_threshold) {
+        if (sizes[i] > hit_size_threshold) {
             continue;
         }
-        auto& kmer_positions = positions.at(i);
-        index->get_kmer_positions(k, kmer_positions);
+        informative.push_back(kmers[i]);
+        informative_idx.push_back(i);
+    }
+
+    vector<map<int64_t, vector<int32_t> > > hits;
+    index->get_kmer_positions(informative, hits);
+    for (size_t j = 0; j < hits.size(); ++j) {
+        auto& kmer_positions = hits[j];
         // ignore this kmer if it has too many hits
         // typically this will be filtered out by the approximate matches filter
         if (kmer_positions.size() > hit_max) kmer_positions.clear();
-        kmer_count += kmer_positions.size();
-        // break when we get more than a threshold number of kmers to seed further alignment
-        //if (kmer_count >= kmer_threshold) break;
-        ++i;
+        positions[informative_idx[j]].swap(kmer_positions);
     }
+}
 
-    if (debug) cerr << "kept kmer hits " << kmer_count << endl;
-
-    // make threads
-    // these start whenever we have a kmer match which is outside of
-    // one of the last positions (for the previous kmer) + the kmer stride % wobble (hmm)
+Alignment& Mapper::align_threaded(Alignment& alignment, int& kmer_count, int kmer_size, int stride, int attempt) {
+    vector<int> offsets;
+    auto kmers = seed_kmers(alignment.sequence(), kmer_size, stride, offsets);
+    vector<map<int64_t, vector<int32_t> > > positions;
+    find_kmer_positions(kmers, positions);
+    return align_threaded(alignment, kmers, offsets, positions, kmer_count, kmer_size, stride, attempt);
+}
 
-    map<int64_t, vector<int> > node_kmer_order;
-    map<pair<int64_t, int32_t>, vector<int64_t> > position_threads;
-    map<int64_t, vector<int64_t> > node_threads;
-    //int node_wobble = 0; // turned off...
-    int position_wobble = 2;
+Alignment& Mapper::align_threaded(Alignment& alignment,
+                                  const vector<string>& kmers,
+                                  const vector<int>& offsets,
+                                  vector<map<int64_t, vector<int32_t> > >& positions,
+                                  int& kmer_count,
+                                  int kmer_size,
+                                  int stride,
+                                  int attempt) {
 
-    int max_iter = sequence.size();
-    int iter = 0;
-    int context_step = 1;
-    int64_t max_subgraph_size = 0;
-    int max_thread_gap = 30; // counted in nodes
+    // parameters, some of which should probably be modifiable
+    // TODO -- move to Mapper object
 
-    i = 0;
-    for (auto& p : positions) {
-        auto& kmer = kmers.at(i++);
-        for (auto& x : p) {
-            int64_t id = x.first;
-            vector<int32_t>& pos = x.second;
-            node_kmer_order[id].push_back(i-1);
-            for (auto& y : pos) {
-                //cerr << kmer << "\t" << i << "\t" << id << "\t" << y << endl;
-                // thread rules
-                // if we find the previous position
-                int m = 0;
-                vector<int64_t> thread;
-                for (int j = 0; j < 2*position_wobble + 1; ++j) {
-                    if (j == 0) { // on point
-                    } else if (j % 2 == 0) { // subtract
-                        m *= -1;
-                    } else { // add
-                        m *= -1; ++m;
-                    }
-                    //cerr << "checking " << id << " " << y << " - " << kmer_size << " + " << m << endl;
-                    auto previous = position_threads.find(make_pair(id, y - stride + m));
-                    if (previous != position_threads.end()) {
-                        //length = position_threads[make_pair(id, y - stride + m)] + 1;
-                        thread = previous->second;
-                        position_threads.erase(previous);
-                        //cerr << "thread is " << thread.size() << " long" << endl;
-                        break;
-                    }
-                }
-
-                thread.push_back(id);
-                position_threads[make_pair(id, y)] = thread;
-                node_threads[id] = thread;
-            }
-        }
+    if (index == NULL) {
+        cerr << "error:[vg::Mapper] no index loaded, cannot map alignment!" << endl;
+        exit(1);
     }
 
-    map<int, vector<vector<int64_t> > > threads_by_length;
-    for (auto& t : node_threads) {
-        auto& thread = t.second;
-        auto& threads = threads_by_length[thread.size()];
-        threads.push_back(thread);
+    const string& sequence = alignment.sequence();
+
+    int hit_count = 0;
+    for (auto& kmer_positions : positions) {
+        kmer_count += kmer_positions.size();
+        for (auto& x : kmer_positions) hit_count += x.second.size();
     }
 
-    // now sort the threads and re-cluster them
+    if (debug) cerr << "kept kmer hits " << kmer_count << endl;
 
-    if (debug) {
-        for (auto& t : threads_by_length) {
-            auto& length = t.first;
-            auto& threads = t.second;
-            cerr << length << ":" << endl;
-            for (auto& thread : threads) {
-                cerr << "\t";
-                for (auto& id : thread) {
-                    cerr << id << " ";
-                }
-                cerr << endl;
+    // chain the seed hits
+    // every hit goes into one flat array, sorted by graph position, and we find the
+    // best scoring colinear chains of hits through it with a dynamic program
+    // each chain drives the extraction of one node range from the index
+
+    int max_thread_gap = 30; // counted in nodes
+    int chain_lookback = 50; // number of preceding hits we consider as predecessors
+    int thread_ex = thread_extension;
+
+    vector<SeedHit> hits;
+    hits.reserve(hit_count);
+    for (int i = 0; i < positions.size(); ++i) {
+        for (auto& x : positions[i]) {
+            for (auto& pos : x.second) {
+                hits.push_back(SeedHit(x.first, pos, offsets[i]));
             }
-            cerr << endl;
         }
     }
 
-    // sort threads by ids
-    // if they are at least 2 hits long
-    set<vector<int64_t> > sorted_threads;
-    auto tl = threads_by_length.rbegin();
-    for (auto& t : node_threads) {
-        auto& thread = t.second;
-        sorted_threads.insert(thread);
-    }
-    // clean up
-    threads_by_length.clear();
-
-    // go back through and combine closely-linked threads
-    // ... but only if their kmer order is proper
-    map<int64_t, vector<int64_t> > threads_by_last;
-    for (auto& thread : sorted_threads) {
-        //cerr << thread.front() << "-" << thread.back() << endl;
-        auto prev = threads_by_last.upper_bound(thread.front()-max_thread_gap);
-        //if (prev != threads_by_last.begin()) --prev;
-        // now we should be at the highest thread within the bounds
-        //cerr << prev->first << " " << thread.front() << endl;
-        // todo: it may also make sense to check that the kmer order makes sense
-        // what does this mean? it means that the previous 
-        if (prev != threads_by_last.end()
-            && prev->first > thread.front() - max_thread_gap) {
-            vector<int64_t> new_thread;
-            auto& prev_thread = prev->second;
-            new_thread.reserve(prev_thread.size() + thread.size());
-            new_thread.insert(new_thread.end(), prev_thread.begin(), prev_thread.end());
-            new_thread.insert(new_thread.end(), thread.begin(), thread.end());
-            threads_by_last.erase(prev);
-            // this will clobber... not good
-            // maybe overwrite only if longer?
-            threads_by_last[new_thread.back()] = new_thread;
-        } else {
-            threads_by_last[thread.back()] = thread;
-        }
-    }
+    vector<SeedChain> chains;
+    chain_seed_hits(hits, kmer_size, max_thread_gap, chain_lookback, chains);
 
-    // debugging
-    /*
-    for (auto& t : threads_by_last) {
-        auto& thread = t.second;
-        cerr << t.first << "\t";
-        for (auto& id : thread) {
-            cerr << id << " ";
+    if (debug) {
+        for (auto& chain : chains) {
+            cerr << "chain " << chain.score << " " << chain.hit_count << " "
+                 << chain.first_id << "-" << chain.last_id << endl;
         }
-        cerr << endl;
     }
-    */
 
-    // rebuild our threads_by_length set
-    for (auto& t : threads_by_last) {
-        auto& thread = t.second;
-        auto& threads = threads_by_length[thread.size()];
-        threads.push_back(thread);
-    }
-
-    int thread_ex = thread_extension;
     VG* graph = new VG;
-
-    // collect the nodes from the best N threads by length
-    // and expand subgraphs as before
-    //cerr << "extending by " << thread_ex << endl;
-    tl = threads_by_length.rbegin();
-    for (int i = 0; tl != threads_by_length.rend() && (best_clusters == 0 || i < best_clusters); ++i, ++tl) {
-        auto& threads = tl->second;
-        // by definition, our thread should construct a contiguous graph
-        for (auto& thread : threads) {
-            // thread extension should be determined during iteration
-            // note that there is a problem and hits tend to be imbalanced
-            //int64_t first = max((int64_t)0, *thread.begin() - thread_ex);
-            //int64_t last = *thread.rbegin() + thread_ex;
-            int64_t first = *thread.begin();
-            int64_t last = *thread.rbegin();
-            // so we can pick it up efficiently from the index by pulling the range from first to last
-            if (debug) cerr << "getting node range " << first << "-" << last << endl;
-            index->get_range(first, last, *graph);
+    // where the nodes of the chains start in the read
+    map<int64_t, int32_t> anchors;
+
+    // collect the node ranges of the best N chains, or of every chain scoring
+    // at least half as well as the best if we haven't been told how many to use
+    for (int i = 0; i < chains.size() && (best_clusters == 0 || i < best_clusters); ++i) {
+        auto& chain = chains[i];
+        if (best_clusters == 0 && chain.score * 2 < chains.front().score) break;
+        for (auto& hit : chain.hits) {
+            anchors.insert(make_pair(hit.node_id, hit.read_offset - hit.node_offset));
         }
+        // by definition, our chain should construct a contiguous graph
+        // so we can pick it up efficiently from the index by pulling the range from first to last
+        if (debug) cerr << "getting node range " << chain.first_id << "-" << chain.last_id << endl;
+        get_cached_range(chain.first_id, chain.last_id, *graph);
     }
 
     // by default, expand the graph a bit so we are likely to map
     //index->get_connected_nodes(*graph);
     graph->remove_orphan_edges();
     // align
-    alignment.clear_path();
-    graph->align(alignment);
+    align_to_graph(alignment, *graph, anchors);
     delete graph;
 
     int sc_start = softclip_start(alignment);
@@ -428,10 +492,11 @@ Alignment& Mapper::align_threaded(Alignment& alignment, int& kmer_count, int kme
         int64_t first = max((int64_t)0, idf - (int64_t)(sc_start ? thread_ex * 10 : 0));
         int64_t last =   idl + (int64_t)(sc_end ? thread_ex * 10 : 0);
         if (debug) cerr << "getting node range " << first << "-" << last << endl;
-        index->get_range(first, last, *graph);
+        get_cached_range(first, last, *graph);
         graph->remove_orphan_edges();
-        alignment.clear_path();
-        graph->align(alignment);
+        map<int64_t, int32_t> anchors;
+        alignment_anchors(alignment, anchors);
+        align_to_graph(alignment, *graph, anchors);
         if (debug) cerr << "softclip after " << softclip_start(alignment) << " " << softclip_end(alignment) << endl;
         delete graph;
 
@@ -443,6 +508,53 @@ Alignment& Mapper::align_threaded(Alignment& alignment, int& kmer_count, int kme
 
 }
 
+void Mapper::align_to_graph(Alignment& alignment, VG& graph, const map<int64_t, int32_t>& anchors) {
+
+    alignment.clear_path();
+
+    if (band_width > 0 && !anchors.empty()) {
+        VG band;
+        graph.offset_band(anchors, -band_width, alignment.sequence().size() + band_width, band);
+        if (debug) cerr << "aligning to band of " << band.node_count()
+                        << " of " << graph.node_count() << " nodes" << endl;
+        if (!band.empty()) {
+            band.align(alignment);
+            // the band was good enough if the read aligned through it without clipping
+            if (alignment.score() > 0
+                && softclip_start(alignment) <= softclip_threshold
+                && softclip_end(alignment) <= softclip_threshold) {
+                return;
+            }
+            if (debug) cerr << "band alignment failed, aligning to the full graph" << endl;
+            alignment.clear_path();
+            alignment.set_score(0);
+        }
+    }
+
+    graph.align(alignment);
+}
+
+void alignment_anchors(const Alignment& alignment, map<int64_t, int32_t>& anchors) {
+    int32_t read_offset = 0;
+    for (int i = 0; i < alignment.path().mapping_size(); ++i) {
+        auto& mapping = alignment.path().mapping(i);
+        // the node starts mapping.offset() before the first base of the read matched to it
+        int32_t matched = read_offset;
+        bool found = false;
+        for (int j = 0; j < mapping.edit_size(); ++j) {
+            auto& edit = mapping.edit(j);
+            if (!found && edit.from_length() > 0) {
+                matched = read_offset;
+                found = true;
+            }
+            read_offset += edit.to_length();
+        }
+        if (found) {
+            anchors.insert(make_pair(mapping.node_id(), matched - (int32_t)mapping.offset()));
+        }
+    }
+}
+
 int softclip_start(Alignment& alignment) {
     if (alignment.mutable_path()->mapping_size() > 0) {
         Path* path = alignment.mutable_path();
@@ -544,16 +656,120 @@ const int balanced_stride(int read_length, int kmer_size, int stride) {
     }
 }
 
-const vector<string> balanced_kmers(const string& seq, const int kmer_size, const int stride) {
+const vector<int> balanced_kmer_offsets(const string& seq, const int kmer_size, const int stride) {
     // choose the closest stride that will generate balanced kmers
-    vector<string> kmers;
+    vector<int> offsets;
     int b = balanced_stride(seq.size(), kmer_size, stride);
     if (!seq.empty()) {
         for (int i = 0; i+kmer_size < seq.size(); i+=b) {
-            kmers.push_back(seq.substr(i,kmer_size));
+            offsets.push_back(i);
         }
     }
+    return offsets;
+}
+
+const vector<string> balanced_kmers(const string& seq, const int kmer_size, const int stride) {
+    vector<string> kmers;
+    for (auto i : balanced_kmer_offsets(seq, kmer_size, stride)) {
+        kmers.push_back(seq.substr(i,kmer_size));
+    }
     return kmers;
 }
 
+const vector<int> minimizer_kmer_offsets(const string& seq, const int kmer_size, const int window) {
+    vector<int> offsets;
+    vector<bool> is_minimizer;
+    mark_minimizers(seq, kmer_size, window, is_minimizer);
+    for (int i = 0; i < is_minimizer.size(); ++i) {
+        if (is_minimizer[i]) {
+            offsets.push_back(i);
+        }
+    }
+    return offsets;
+}
+
+const vector<string> minimizer_kmers(const string& seq, const int kmer_size, const int window) {
+    vector<string> kmers;
+    for (auto i : minimizer_kmer_offsets(seq, kmer_size, window)) {
+        kmers.push_back(seq.substr(i, kmer_size));
+    }
+    return kmers;
+}
+
+void chain_seed_hits(vector<SeedHit>& hits,
+                     int kmer_size,
+                     int max_gap,
+                     int lookback,
+                     vector<SeedChain>& chains) {
+
+    chains.clear();
+    if (hits.empty()) return;
+
+    // order by position in the graph, node ids approximate the graph's topological order
+    std::sort(hits.begin(), hits.end());
+    hits.erase(std::unique(hits.begin(), hits.end()), hits.end());
+
+    int n = hits.size();
+    vector<int> score(n);
+    vector<int> prev(n, -1);
+
+    for (int i = 0; i < n; ++i) {
+        auto& hit = hits[i];
+        score[i] = kmer_size;
+        // scan back over the nearest preceding hits while they are within the node gap
+        for (int j = i - 1; j >= 0 && i - j <= lookback; --j) {
+            auto& p = hits[j];
+            if (hit.node_id - p.node_id > max_gap) break;
+            int read_dist = hit.read_offset - p.read_offset;
+            if (read_dist <= 0) continue; // not colinear in the read
+            int gap;
+            if (p.node_id == hit.node_id) {
+                int node_dist = hit.node_offset - p.node_offset;
+                if (node_dist <= 0) continue;
+                // how far we step off the diagonal
+                gap = abs(read_dist - node_dist);
+            } else {
+                // we don't know the distance in the graph, so charge for the nodes we skip
+                gap = hit.node_id - p.node_id - 1;
+            }
+            // overlapping kmers only add the bases they newly cover
+            int s = score[j] + min(read_dist, kmer_size) - gap;
+            if (s > score[i]) {
+                score[i] = s;
+                prev[i] = j;
+            }
+        }
+    }
+
+    // trace back from the best chain ends, each hit belongs to at most one chain
+    vector<int> ends(n);
+    for (int i = 0; i < n; ++i) ends[i] = i;
+    std::sort(ends.begin(), ends.end(), [&score](int a, int b) {
+            return score[a] > score[b];
+        });
+    vector<bool> used(n, false);
+    for (auto i : ends) {
+        if (used[i]) continue;
+        SeedChain chain;
+        chain.score = score[i];
+        chain.hit_count = 0;
+        chain.first_id = hits[i].node_id;
+        chain.last_id = hits[i].node_id;
+        int j = i;
+        for ( ; j >= 0 && !used[j]; j = prev[j]) {
+            used[j] = true;
+            chain.first_id = hits[j].node_id;
+            chain.hits.push_back(hits[j]);
+            ++chain.hit_count;
+        }
+        std::reverse(chain.hits.begin(), chain.hits.end());
+        // if we ran into an earlier chain, only count what this one adds
+        if (j >= 0) chain.score -= score[j];
+        chains.push_back(chain);
+    }
+    std::sort(chains.begin(), chains.end(), [](const SeedChain& a, const SeedChain& b) {
+            return a.score > b.score;
+        });
+}
+
 }
@@ -5,22 +5,53 @@
 #include <map>
 #include <chrono>
 #include <ctime>
+#include <memory>
 #include "vg.hpp"
 #include "index.hpp"
+#include "kmer_table.hpp"
 #include "pb2json.h"
 
 namespace vg {
 
 using namespace std;
 
+// a kmer of the read matching the graph
+struct SeedHit {
+    int64_t node_id;
+    int32_t node_offset;
+    int32_t read_offset;
+    SeedHit(int64_t id, int32_t n, int32_t r) : node_id(id), node_offset(n), read_offset(r) { }
+    bool operator<(const SeedHit& other) const {
+        if (node_id != other.node_id) return node_id < other.node_id;
+        if (node_offset != other.node_offset) return node_offset < other.node_offset;
+        return read_offset < other.read_offset;
+    }
+    bool operator==(const SeedHit& other) const {
+        return node_id == other.node_id
+            && node_offset == other.node_offset
+            && read_offset == other.read_offset;
+    }
+};
+
+// a colinear run of hits, and the node id range it covers
+struct SeedChain {
+    int score;
+    int hit_count;
+    int64_t first_id;
+    int64_t last_id;
+    vector<SeedHit> hits; // in graph order
+};
+
 class Mapper {
 
 public:
 
-    Mapper(Index* idex);
-    Mapper(void) : index(NULL), best_clusters(0) { }
+    Mapper(Index* idex, KmerTable* table = NULL);
+    Mapper(void);
     ~Mapper(void);
     Index* index;
+    // if set, kmers are looked up here rather than in the index
+    KmerTable* kmer_table;
 
     Alignment align(string& seq, int kmer_size = 0, int stride = 0);
     Alignment align(Alignment& read, int kmer_size = 0, int stride = 0);
@@ -40,6 +71,30 @@ public:
                               int kmer_size = 0,
                               int stride = 0,
                               int attempt = 0);
+    // as above, but with kmers, starting at offsets in the read, whose positions have already been looked up
+    Alignment& align_threaded(Alignment& read,
+                              const vector<string>& kmers,
+                              const vector<int>& offsets,
+                              vector<map<int64_t, vector<int32_t> > >& positions,
+                              int& hit_count,
+                              int kmer_size,
+                              int stride,
+                              int attempt);
+
+    // the kmers of the read we use for seeding, balanced or minimizers,
+    // and in offsets where they start in the read
+    vector<string> seed_kmers(const string& seq, int kmer_size, int stride, vector<int>& offsets);
+
+    // batched seeding, looks up all the kmers at once and drops uninformative ones
+    void find_kmer_positions(const vector<string>& kmers,
+                             vector<map<int64_t, vector<int32_t> > >& positions);
+
+    // aligns to the nodes within band_width of the anchors, which give the estimated
+    // offsets of node starts in the read, and to the whole graph if that fails
+    void align_to_graph(Alignment& alignment, VG& graph, const map<int64_t, int32_t>& anchors);
+
+    // pulls the subgraph of the node id range into graph, using our cache of recently used ranges
+    void get_cached_range(int64_t from_id, int64_t to_id, VG& graph);
 
     // not used
     Alignment& align_simple(Alignment& alignment, int kmer_size = 0, int stride = 0);
@@ -58,6 +113,20 @@ public:
     int softclip_threshold;
     float target_score_per_bp;
     bool prefer_forward;
+    int minimizer_window; // seed with (window,k)-minimizers rather than balanced kmers if > 0
+    int band_width; // if > 0, first align only to the nodes within this many bp of the seed anchors
+
+    // subgraphs by node id range, so hot regions aren't re-read from the index
+    // each thread has its own mapper, so this needs no locking
+    // the graphs are shared, so a hit doesn't copy them out of the cache
+    LRUCache<string, shared_ptr<Graph> >* range_cache;
+    int range_cache_size; // 0 disables the cache
+    uint64_t range_cache_hits;
+    uint64_t range_cache_misses;
+    // alignable graphs of the windows we rescue mates in, built once and reused
+    // for each mate rescued in the same window
+    LRUCache<string, shared_ptr<VG> >* rescue_cache;
+    int rescue_cache_size; // 0 disables the cache
 
 };
 
@@ -65,6 +134,19 @@ public:
 int softclip_start(Alignment& alignment);
 int softclip_end(Alignment& alignment);
 const vector<string> balanced_kmers(const string& seq, int kmer_size, int stride);
+const vector<int> balanced_kmer_offsets(const string& seq, int kmer_size, int stride);
+const vector<string> minimizer_kmers(const string& seq, int kmer_size, int window);
+const vector<int> minimizer_kmer_offsets(const string& seq, int kmer_size, int window);
+// the estimated offsets in the read of the starts of the nodes an alignment touches
+void alignment_anchors(const Alignment& alignment, map<int64_t, int32_t>& anchors);
+// colinear chaining of hits, sorting them by graph position
+// O(n log n) to sort plus O(n * lookback) for the dynamic program
+// chains are returned best first
+void chain_seed_hits(vector<SeedHit>& hits,
+                     int kmer_size,
+                     int max_gap,
+                     int lookback,
+                     vector<SeedChain>& chains);
 
 
 }
@@ -0,0 +1,207 @@
+#ifndef MPMC_QUEUE_H
+#define MPMC_QUEUE_H
+
+// bounded multi-producer multi-consumer queue
+// after Dmitry Vyukov's http://www.1024cores.net/home/lock-free-algorithms/queues/bounded-mpmc-queue
+// try_push and try_pop are lock free, each cell carries a sequence number
+// which tells producers and consumers whose turn it is to use it
+// pop_wait lets consumers sleep until there is work or the queue is closed,
+// and push_wait lets producers sleep until there is room
+
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <vector>
+#include <functional>
+#include <cstddef>
+#include <cstdint>
+#include <omp.h>
+
+namespace vg {
+
+template <typename T>
+class MPMCQueue {
+
+public:
+
+    // the capacity is rounded up to a power of two
+    MPMCQueue(size_t capacity)
+        : closed(false)
+    {
+        size_t size = 2;
+        while (size < capacity) size <<= 1;
+        mask = size - 1;
+        buffer = new Cell[size];
+        for (size_t i = 0; i < size; ++i) {
+            buffer[i].sequence.store(i, std::memory_order_relaxed);
+        }
+        enqueue_pos.store(0, std::memory_order_relaxed);
+        dequeue_pos.store(0, std::memory_order_relaxed);
+    }
+
+    ~MPMCQueue(void) {
+        delete [] buffer;
+    }
+
+    MPMCQueue(const MPMCQueue&) = delete;
+    MPMCQueue& operator=(const MPMCQueue&) = delete;
+
+    // returns false if the queue is full
+    bool try_push(const T& item) {
+        Cell* cell;
+        size_t pos = enqueue_pos.load(std::memory_order_relaxed);
+        while (true) {
+            cell = &buffer[pos & mask];
+            size_t seq = cell->sequence.load(std::memory_order_acquire);
+            intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+            if (diff == 0) {
+                if (enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = enqueue_pos.load(std::memory_order_relaxed);
+            }
+        }
+        cell->data = item;
+        cell->sequence.store(pos + 1, std::memory_order_release);
+        // taking the lock means a consumer can't miss this between checking and sleeping
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+        }
+        not_empty.notify_one();
+        return true;
+    }
+
+    // returns false if the queue is empty
+    bool try_pop(T& item) {
+        Cell* cell;
+        size_t pos = dequeue_pos.load(std::memory_order_relaxed);
+        while (true) {
+            cell = &buffer[pos & mask];
+            size_t seq = cell->sequence.load(std::memory_order_acquire);
+            intptr_t diff = (intptr_t)seq - (intptr_t)(pos + 1);
+            if (diff == 0) {
+                if (dequeue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = dequeue_pos.load(std::memory_order_relaxed);
+            }
+        }
+        item = cell->data;
+        cell->sequence.store(pos + mask + 1, std::memory_order_release);
+        // as in try_push, so a producer can't miss this between checking and sleeping
+        {
+            std::lock_guard<std::mutex> lock(full_mutex);
+        }
+        not_full.notify_one();
+        return true;
+    }
+
+    // sleeps until there is room for the item
+    void push_wait(const T& item) {
+        while (!try_push(item)) {
+            std::unique_lock<std::mutex> lock(full_mutex);
+            not_full.wait(lock, [this]() { return has_room(); });
+        }
+    }
+
+    // sleeps until an item is available, returns false once the queue is closed and drained
+    bool pop_wait(T& item) {
+        if (try_pop(item)) return true;
+        std::unique_lock<std::mutex> lock(mutex);
+        bool popped = false;
+        not_empty.wait(lock, [this, &item, &popped]() {
+                popped = try_pop(item);
+                return popped || closed.load();
+            });
+        // we may have been woken by closing with items left
+        return popped || try_pop(item);
+    }
+
+    // no more items will be pushed, wakes all the sleeping consumers
+    void close(void) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            closed.store(true);
+        }
+        not_empty.notify_all();
+    }
+
+private:
+
+    // true if the next push may succeed, this takes no locks
+    // so that it can be checked while holding full_mutex
+    bool has_room(void) {
+        size_t pos = enqueue_pos.load(std::memory_order_relaxed);
+        size_t seq = buffer[pos & mask].sequence.load(std::memory_order_acquire);
+        return (intptr_t)seq - (intptr_t)pos >= 0;
+    }
+
+    struct Cell {
+        std::atomic<size_t> sequence;
+        T data;
+    };
+
+    // keep the producer and consumer positions on separate cache lines
+    char pad0[64];
+    Cell* buffer;
+    size_t mask;
+    char pad1[64];
+    std::atomic<size_t> enqueue_pos;
+    char pad2[64];
+    std::atomic<size_t> dequeue_pos;
+    char pad3[64];
+
+    std::atomic<bool> closed;
+    std::mutex mutex;
+    std::condition_variable not_empty;
+    std::mutex full_mutex;
+    std::condition_variable not_full;
+
+};
+
+// reads the input on a thread of its own, which hands the batches to the openmp
+// threads through a bounded queue, so reading never stops to run lambda and the
+// input is read as fast as it can be however many threads we have
+// when the queue is full the reader sleeps, as the threads are behind anyway
+// produce fills the empty batch it is given and returns false once the input is
+// exhausted; it runs on the reader thread, and lambda on the openmp threads
+template <typename T>
+void for_each_batch_parallel(const std::function<bool(std::vector<T>&)>& produce,
+                             const std::function<void(T&)>& lambda) {
+    MPMCQueue<std::vector<T>*> batches(omp_get_max_threads() * 4);
+    std::thread reader([&produce, &batches](void) {
+            bool more = true;
+            while (more) {
+                std::vector<T>* batch = new std::vector<T>;
+                more = produce(*batch);
+                if (batch->empty()) {
+                    delete batch;
+                } else {
+                    batches.push_wait(batch);
+                }
+            }
+            batches.close();
+        });
+#pragma omp parallel shared(batches)
+    {
+        std::vector<T>* batch;
+        while (batches.pop_wait(batch)) {
+            for (auto& object : *batch) {
+                lambda(object);
+            }
+            delete batch;
+        }
+    }
+    reader.join();
+}
+
+}
+
+#endif
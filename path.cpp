@@ -8,6 +8,13 @@ Paths::Paths(void) {
     // noop
 }
 
+void Paths::swap(Paths& other) {
+    _paths.swap(other._paths);
+    mapping_itr.swap(other.mapping_itr);
+    mapping_path.swap(other.mapping_path);
+    node_mapping.swap(other.node_mapping);
+}
+
 void Paths::load(istream& in) {
     uint64_t count = 0;
     function<void(uint64_t)> handle_count = [this, &count](uint64_t c) { count = c; };
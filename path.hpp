@@ -28,9 +28,7 @@ public:
     }
     // move constructor
     Paths(Paths&& other) noexcept {
-        _paths = other._paths;
-        other.clear();
-        rebuild_node_mapping();
+        swap(other);
     }
 
     // copy assignment operator
@@ -42,11 +40,14 @@ public:
 
     // move assignment operator
     Paths& operator=(Paths&& other) noexcept {
-        std::swap(_paths, other._paths);
-        rebuild_node_mapping();
+        swap(other);
         return *this;
     }
 
+    // exchanges the paths and their indexes in O(1)
+    // the mappings stay in their lists, so the Mapping*s in the indexes stay valid
+    void swap(Paths& other);
+
     map<string, list<Mapping> > _paths;
     map<Mapping*, list<Mapping>::iterator> mapping_itr;
     map<Mapping*, string> mapping_path;
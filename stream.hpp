@@ -9,54 +9,122 @@
 #include <functional>
 #include <vector>
 #include <list>
+#include <string>
+#include <algorithm>
+#include <cstring>
+#include <cstdlib>
+#include <omp.h>
+#include <zlib.h>
 #include <google/protobuf/stubs/common.h>
 #include <google/protobuf/io/zero_copy_stream.h>
 #include <google/protobuf/io/zero_copy_stream_impl.h>
 #include <google/protobuf/io/gzip_stream.h>
 #include <google/protobuf/io/coded_stream.h>
+#include "mpmc_queue.hpp"
 
 namespace stream {
 
+// compress data into BGZF blocks
+// these are gzip members of at most 64KB, which record their compressed size in a
+// BC extra field, so the output reads as a single gzip stream, or with bgzf readers
+// level runs from 0 (stored) to 9, or Z_DEFAULT_COMPRESSION
+inline void bgzf_compress(const std::string& data, std::string& compressed, int level) {
+    const size_t block_size = 0xff00; // as in htslib, leaves room for incompressible data
+    const size_t header_size = 18;
+    const size_t footer_size = 8;
+    static const unsigned char header[16] = {
+        0x1f, 0x8b, 8, 4, 0, 0, 0, 0, 0, 0xff, 6, 0, 'B', 'C', 2, 0
+    };
+    auto put_le = [](unsigned char* p, uint32_t v, int bytes) {
+        for (int i = 0; i < bytes; ++i) p[i] = (v >> (8 * i)) & 0xff;
+    };
+
+    size_t offset = 0;
+    do {
+        size_t length = std::min(block_size, data.size() - offset);
+        z_stream zs;
+        memset(&zs, 0, sizeof(zs));
+        if (deflateInit2(&zs, level, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+            std::cerr << "error:[stream] could not initialize compression at level " << level << std::endl;
+            exit(1);
+        }
+        size_t bound = deflateBound(&zs, length);
+        size_t start = compressed.size();
+        compressed.resize(start + header_size + bound + footer_size);
+        unsigned char* block = (unsigned char*) &compressed[start];
+        zs.next_in = (Bytef*) data.data() + offset;
+        zs.avail_in = length;
+        zs.next_out = block + header_size;
+        zs.avail_out = bound;
+        if (deflate(&zs, Z_FINISH) != Z_STREAM_END) {
+            std::cerr << "error:[stream] compression failed" << std::endl;
+            exit(1);
+        }
+        size_t cdata_size = zs.total_out;
+        deflateEnd(&zs);
+
+        size_t block_length = header_size + cdata_size + footer_size;
+        memcpy(block, header, sizeof(header));
+        put_le(block + 16, block_length - 1, 2);
+        uint32_t crc = crc32(crc32(0L, NULL, 0), (const Bytef*) data.data() + offset, length);
+        put_le(block + header_size + cdata_size, crc, 4);
+        put_le(block + header_size + cdata_size + 4, length, 4);
+        compressed.resize(start + block_length);
+        offset += length;
+    } while (offset < data.size());
+}
+
+// serialize a chunk of objects, get(n) returns the nth
+// the chunk is prefixed with the number of objects, and each object with its size
+template <typename Get>
+void serialize_chunk(std::string& data, uint64_t count, Get get) {
+    ::google::protobuf::io::StringOutputStream string_out(&data);
+    {
+        // trims the string to what was written when it goes away
+        ::google::protobuf::io::CodedOutputStream coded_out(&string_out);
+        coded_out.WriteVarint64(count);
+        std::string s;
+        for (uint64_t n = 0; n < count; ++n) {
+            get(n).SerializeToString(&s);
+            coded_out.WriteVarint32(s.size());
+            coded_out.WriteRaw(s.data(), s.size());
+        }
+    }
+}
+
 // write objects
 // count should be equal to the number of objects to write
 // but if it is 0, it is not written
 // if not all objects are written, return false, otherwise true
 template <typename T>
-bool write(std::ostream& out, uint64_t count, std::function<T(uint64_t)>& lambda) {
-
-    ::google::protobuf::io::ZeroCopyOutputStream *raw_out =
-          new ::google::protobuf::io::OstreamOutputStream(&out);
-    ::google::protobuf::io::GzipOutputStream *gzip_out =
-          new ::google::protobuf::io::GzipOutputStream(raw_out);
-    ::google::protobuf::io::CodedOutputStream *coded_out =
-          new ::google::protobuf::io::CodedOutputStream(gzip_out);
-
-    // prefix the chunk with the number of objects
-    coded_out->WriteVarint64(count);
-
-    std::string s;
-    uint64_t written = 0;
-    for (uint64_t n = 0; n < count; ++n, ++written) {
-        lambda(n).SerializeToString(&s);
-        // and prefix each object with its size
-        coded_out->WriteVarint32(s.size());
-        coded_out->WriteRaw(s.data(), s.size());
-    }
+bool write(std::ostream& out, uint64_t count, std::function<T(uint64_t)>& lambda,
+           int level = Z_DEFAULT_COMPRESSION) {
 
-    delete coded_out;
-    delete gzip_out;
-    delete raw_out;
+    std::string data;
+    std::string compressed;
+    serialize_chunk(data, count, lambda);
+    bgzf_compress(data, compressed, level);
+    out.write(compressed.data(), compressed.size());
 
-    return !count || written == count;
+    return out.good();
 }
 
+// serialization and compression happen in the calling thread
+// only the write of the compressed chunk is serialized between threads
 template <typename T>
-bool write_buffered(std::ostream& out, std::vector<T>& buffer, uint64_t buffer_limit) {
+bool write_buffered(std::ostream& out, std::vector<T>& buffer, uint64_t buffer_limit,
+                    int level = Z_DEFAULT_COMPRESSION) {
     bool wrote = false;
     if (buffer.size() >= buffer_limit) {
-        std::function<T(uint64_t)> lambda = [&buffer](uint64_t n) { return buffer.at(n); };
+        std::string data;
+        std::string compressed;
+        serialize_chunk(data, buffer.size(), [&buffer](uint64_t n) -> const T& { return buffer[n]; });
+        bgzf_compress(data, compressed, level);
 #pragma omp critical (stream_out)
-        wrote = write(out, buffer.size(), lambda);
+        {
+            out.write(compressed.data(), compressed.size());
+            wrote = out.good();
+        }
         buffer.clear();
     }
     return wrote;
@@ -114,7 +182,184 @@ template <typename T>
 bool for_each(std::istream& in,
               std::function<void(T&)>& lambda) {
     std::function<void(uint64_t)> noop = [](uint64_t) { };
-    for_each(in, lambda, noop);
+    return for_each(in, lambda, noop);
+}
+
+// reads the next BGZF block whole, still compressed
+// returns 1 for a block, 0 at the end of the input, -1 if what follows isn't a BGZF block
+// and -2 if the block is truncated
+inline int read_bgzf_block(std::istream& in, std::string& block) {
+    const size_t header_size = 18;
+    block.resize(header_size);
+    in.read(&block[0], header_size);
+    if (in.gcount() == 0) return 0;
+    const unsigned char* header = (const unsigned char*) block.data();
+    if (in.gcount() < (std::streamsize) header_size
+        || header[0] != 0x1f || header[1] != 0x8b || !(header[3] & 4)
+        || header[12] != 'B' || header[13] != 'C') {
+        return -1;
+    }
+    size_t block_length = (header[16] | (header[17] << 8)) + 1;
+    block.resize(block_length);
+    in.read(&block[header_size], block_length - header_size);
+    if (in.gcount() < (std::streamsize) (block_length - header_size)) return -2;
+    return 1;
+}
+
+// inflates a block from read_bgzf_block into data, returning false if it doesn't decompress
+inline bool inflate_bgzf_block(const std::string& block, std::string& data) {
+    const size_t header_size = 18;
+    const size_t footer_size = 8;
+    const unsigned char* footer = (const unsigned char*) block.data() + block.size() - footer_size;
+    uint32_t isize = footer[4] | (footer[5] << 8) | (footer[6] << 16) | ((uint32_t) footer[7] << 24);
+    data.resize(isize);
+    if (isize == 0) return true;
+    z_stream zs;
+    memset(&zs, 0, sizeof(zs));
+    inflateInit2(&zs, -15);
+    zs.next_in = (Bytef*) block.data() + header_size;
+    zs.avail_in = block.size() - header_size - footer_size;
+    zs.next_out = (Bytef*) &data[0];
+    zs.avail_out = isize;
+    int ret = inflate(&zs, Z_FINISH);
+    inflateEnd(&zs);
+    return ret == Z_STREAM_END;
+}
+
+// reads a varint from buffer at pos, advancing pos, returning false if the buffer ends first
+inline bool read_varint(const std::string& buffer, size_t& pos, uint64_t& value) {
+    value = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        if (pos >= buffer.size()) return false;
+        unsigned char b = buffer[pos++];
+        value |= ((uint64_t) (b & 0x7f)) << shift;
+        if (!(b & 0x80)) return true;
+    }
+    return false;
+}
+
+// calls lambda on the objects of the stream in batches, in the order of the stream
+// when the input is BGZF and seekable, the blocks are inflated and the objects parsed
+// by all the threads, while the lambda runs in the calling thread
+// otherwise this reads the stream as for_each does
+template <typename T>
+bool for_each_batch(std::istream& in,
+                    std::function<void(std::vector<T>&)>& lambda,
+                    std::function<void(uint64_t)>& handle_count) {
+
+    const size_t batch_size = 1024;
+
+    // look at the first block, to see if we can read the blocks ourselves
+    bool bgzf = false;
+    std::streampos start = in.tellg();
+    if (start != std::streampos(-1)) {
+        std::string block;
+        bgzf = read_bgzf_block(in, block) == 1;
+        in.clear();
+        in.seekg(start);
+    }
+
+    if (!bgzf) {
+        std::vector<T> batch;
+        std::function<void(T&)> add = [&lambda, &batch, batch_size](T& object) {
+            batch.emplace_back();
+            batch.back().Swap(&object);
+            if (batch.size() == batch_size) {
+                lambda(batch);
+                batch.clear();
+            }
+        };
+        bool ok = for_each(in, add, handle_count);
+        if (!batch.empty()) {
+            lambda(batch);
+        }
+        return ok;
+    }
+
+    const size_t blocks_per_round = omp_get_max_threads() * 16;
+    std::vector<std::string> blocks(blocks_per_round);
+    std::vector<std::string> datas(blocks_per_round);
+    // decompressed input we haven't consumed yet
+    std::string buffer;
+    // objects left in the chunk we're in
+    uint64_t remaining = 0;
+    bool more_input = true;
+    std::vector<std::pair<size_t, size_t> > messages;
+    std::vector<T> batch;
+
+    while (more_input) {
+        // read the compressed blocks here, and inflate them in parallel
+        size_t n = 0;
+        for ( ; n < blocks_per_round; ++n) {
+            int got = read_bgzf_block(in, blocks[n]);
+            if (got == 0) {
+                more_input = false;
+                break;
+            } else if (got < 0) {
+                std::cerr << "error:[stream] the input is "
+                          << (got == -1 ? "not BGZF throughout" : "truncated") << std::endl;
+                exit(1);
+            }
+        }
+        bool inflated = true;
+#pragma omp parallel for schedule(dynamic, 1)
+        for (size_t i = 0; i < n; ++i) {
+            if (!inflate_bgzf_block(blocks[i], datas[i])) {
+                inflated = false;
+            }
+        }
+        if (!inflated) {
+            std::cerr << "error:[stream] could not decompress a block of the input" << std::endl;
+            exit(1);
+        }
+        for (size_t i = 0; i < n; ++i) {
+            buffer.append(datas[i]);
+        }
+
+        // find the whole messages in the buffer, from the chunk headers and size prefixes
+        messages.clear();
+        size_t pos = 0;
+        while (true) {
+            size_t at = pos;
+            uint64_t value;
+            if (!read_varint(buffer, at, value)) break;
+            if (remaining == 0) {
+                handle_count(value);
+                remaining = value;
+            } else {
+                if (at + value > buffer.size()) break;
+                if (value > 0) {
+                    messages.push_back(std::make_pair(at, value));
+                }
+                at += value;
+                --remaining;
+            }
+            pos = at;
+        }
+
+        // parse them in parallel, and hand them over in order
+        for (size_t first = 0; first < messages.size(); first += batch_size) {
+            size_t count = std::min(batch_size, messages.size() - first);
+            batch.clear();
+            batch.resize(count);
+#pragma omp parallel for schedule(dynamic, 16)
+            for (size_t i = 0; i < count; ++i) {
+                auto& m = messages[first + i];
+                batch[i].ParseFromArray(buffer.data() + m.first, m.second);
+            }
+            lambda(batch);
+        }
+        buffer.erase(0, pos);
+    }
+
+    return buffer.empty();
+}
+
+template <typename T>
+bool for_each_batch(std::istream& in,
+                    std::function<void(std::vector<T>&)>& lambda) {
+    std::function<void(uint64_t)> noop = [](uint64_t) { };
+    return for_each_batch(in, lambda, noop);
 }
 
 template <typename T>
@@ -131,60 +376,42 @@ bool for_each_parallel(std::istream& in,
 
     uint64_t count;
     bool more_input = coded_in->ReadVarint64(&count);
-    bool more_objects = false;
-    // this loop handles a chunked file with many pieces
-    // such as we might write in a multithreaded process
-    std::list<T> objects;
-    int64_t object_count = 0;
-    int64_t read_threshold = 5000;
     if (!count) return !count;
-#pragma omp parallel shared(more_input, more_objects, objects, count, in, lambda, handle_count, raw_in, gzip_in, coded_in)
-    do {
 
-        bool has_object = false;
-        T object;
-#pragma omp critical (objects)
-        {
-            if (!objects.empty()) {
-                object = objects.back();
-                objects.pop_back();
-                --object_count;
-                has_object = true;
-            }
-        }
-        if (has_object) {
-            lambda(object);
-        }
-
-#pragma omp master
-        {
-            while (more_input && object_count < read_threshold) {
-                handle_count(count);
-                std::string s;
-                for (uint64_t i = 0; i < count; ++i) {
-                    uint32_t msgSize = 0;
-                    // the messages are prefixed by their size
-                    delete coded_in;
-                    coded_in = new ::google::protobuf::io::CodedInputStream(gzip_in);
-                    coded_in->ReadVarint32(&msgSize);
-                    if ((msgSize > 0) &&
-                        (coded_in->ReadString(&s, msgSize))) {
-                        T object;
-                        object.ParseFromString(s);
-#pragma omp critical (objects)
-                        {
-                            objects.push_front(object);
-                            ++object_count;
-                        }
-                    }
-                }
+    // the objects are parsed straight into batches on a reader thread of their own,
+    // which hands them to the openmp threads (see vg::for_each_batch_parallel)
+    const size_t batch_size = 256;
+    uint64_t remaining = count; // objects left in this chunk
+    handle_count(count);
+    std::function<bool(std::vector<T>&)> produce = [&](std::vector<T>& batch) {
+        batch.reserve(batch_size);
+        std::string s;
+        // this loop handles a chunked file with many pieces
+        // such as we might write in a multithreaded process
+        while (batch.size() < batch_size) {
+            if (remaining == 0) {
                 more_input = coded_in->ReadVarint64(&count);
+                if (!more_input) return false;
+                handle_count(count);
+                remaining = count;
+                continue;
+            }
+            --remaining;
+            uint32_t msgSize = 0;
+            // the messages are prefixed by their size
+            delete coded_in;
+            coded_in = new ::google::protobuf::io::CodedInputStream(gzip_in);
+            coded_in->ReadVarint32(&msgSize);
+            if ((msgSize > 0) &&
+                (coded_in->ReadString(&s, msgSize))) {
+                // parse in place, so the object is never copied
+                batch.emplace_back();
+                batch.back().ParseFromString(s);
             }
         }
-#pragma omp critical (objects)
-        more_objects = (object_count > 0);
-
-    } while (more_input || more_objects);
+        return true;
+    };
+    vg::for_each_batch_parallel(produce, lambda);
 
     delete coded_in;
     delete gzip_in;
@@ -197,7 +424,7 @@ template <typename T>
 bool for_each_parallel(std::istream& in,
               std::function<void(T&)>& lambda) {
     std::function<void(uint64_t)> noop = [](uint64_t) { };
-    for_each_parallel(in, lambda, noop);
+    return for_each_parallel(in, lambda, noop);
 }
 
 }
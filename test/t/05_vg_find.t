@@ -5,7 +5,7 @@ BASH_TAP_ROOT=../bash-tap
 
 PATH=..:$PATH # for vg
 
-plan tests 12
+plan tests 14
 
 vg construct -r small/x.fa -v small/x.vcf.gz >x.vg
 is $? 0 "construction"
@@ -36,6 +36,19 @@ is $(vg find -t 10 x.vg | wc -l) 1 "we can find edges to"
 
 is $(vg find -f 10 x.vg | wc -l) 1 "we can find edges from"
 
+vg map -r <(vg sim -s 69 -n 200 -l 100 x.vg) x.vg >x.gam
+vg index -G x.gam
+is $(vg find -G x.gam -r 10:20 | vg view -a - | wc -l) \
+   $(vg view -a x.gam | jq -c '[.path.mapping[].node_id | select(. >= 10 and . <= 20)] | length' | grep -v '^0$' | wc -l) \
+   "the GAM index finds the alignments touching a node range"
+
+# vg map writes at most 1000 alignments per chunk, so these span several chunks and many blocks
+vg map -r <(vg sim -s 70 -n 2500 -l 100 x.vg) x.vg >y.gam
+vg index -G y.gam
+is $(vg find -G y.gam -r 150:160 | vg view -a - | wc -l) \
+   $(vg view -a y.gam | jq -c '[.path.mapping[].node_id | select(. >= 150 and . <= 160)] | length' | grep -v '^0$' | wc -l) \
+   "the GAM index seeks into later chunks of a multi-chunk GAM"
+
 rm -rf x.vg.index
-rm -f x.vg
+rm -f x.vg x.gam x.gam.gai y.gam y.gam.gai
 
@@ -5,7 +5,7 @@ BASH_TAP_ROOT=../bash-tap
 
 PATH=..:$PATH # for vg
 
-plan tests 13
+plan tests 19
 
 vg construct -r small/x.fa -v small/x.vcf.gz >x.vg
 is $? 0 "construction"
@@ -77,3 +77,39 @@ is $(vg index -L -d q.idx | tail -1 | awk '{ print $3 }' ) 420 "end of the secon
 
 rm -rf q.idx x.vg y.vg
 
+vg construct -r small/x.fa -v small/x.vcf.gz >x.vg
+vg index -s -k 11 -d x.idx x.vg
+vg index -s -k 11 -K -d x.packed.idx x.vg
+is $(vg index -D -d x.packed.idx | grep '"+k+' | sort | md5sum | cut -f 1 -d\ ) $(vg index -D -d x.idx | grep '"+k+' | sort | md5sum | cut -f 1 -d\ ) "packed kmers hold the same entries as unpacked ones"
+
+unpruned=$(vg index -D -d x.idx | grep '"+k+' | jq -r .key | cut -f 3 -d+ | sort | uniq -c | awk '$1 <= 2' | md5sum | cut -f 1 -d\ )
+vg index -P 2 -d x.idx
+is $(vg index -D -d x.idx | grep '"+k+' | jq -r .key | cut -f 3 -d+ | sort | uniq -c | awk '$1 > 2' | wc -l) 0 "pruning removes the kmers with too many hits"
+is $(vg index -D -d x.idx | grep '"+k+' | jq -r .key | cut -f 3 -d+ | sort | uniq -c | md5sum | cut -f 1 -d\ ) $unpruned "pruning keeps every entry of the kmers with few enough hits"
+
+rm -rf x.idx x.packed.idx x.vg
+
+vg construct -r small/x.fa -v small/x.vcf.gz >x.vg
+vg construct -v small/x.vcf.gz -r small/x.fa | vg view - | sed s/x/y/ | vg view -v - >y.vg
+vg ids -j x.vg y.vg
+vg index -s -k 11 -d q.idx x.vg y.vg
+vg index -I -s -k 11 -d q.inc.idx x.vg
+vg index -I -s -k 11 -d q.inc.idx x.vg y.vg
+is $(vg index -D -d q.inc.idx | grep -v '"+m+' | sort | md5sum | cut -f 1 -d\ ) $(vg index -D -d q.idx | grep -v '"+m+' | sort | md5sum | cut -f 1 -d\ ) "incremental indexing adds only the new graph"
+
+rm -rf q.idx q.inc.idx x.vg y.vg
+
+vg construct -r small/x.fa -v small/x.vcf.gz >x.vg
+vg index -s x.vg
+vg find -r 1:105 x.vg >x1.vg
+vg find -r 106:210 -c 1 x.vg >x2.vg
+vg index -s -k 11 -e 30 -d x.idx x.vg
+vg index -I -s -k 11 -e 30 -d x.inc.idx x1.vg
+vg index -I -k 11 -e 30 -d x.inc.idx x1.vg x2.vg
+is $(vg index -D -d x.inc.idx | grep '"+k+' | sort | md5sum | cut -f 1 -d\ ) $(vg index -D -d x.idx | grep '"+k+' | sort | md5sum | cut -f 1 -d\ ) "incremental kmer indexing covers the kmers spanning into the stored graph"
+
+vg find -r 1:100 x.vg >x1.vg
+vg index -I -s -d x.inc.idx x1.vg 2>/dev/null
+is $? 1 "incremental indexing refuses a graph which has changed since it was indexed"
+
+rm -rf x.vg.index x.idx x.inc.idx x.vg x1.vg x2.vg
@@ -5,7 +5,7 @@ BASH_TAP_ROOT=../bash-tap
 
 PATH=..:$PATH # for vg
 
-plan tests 10
+plan tests 16
 
 vg construct -r small/x.fa -v small/x.vcf.gz >x.vg
 vg index -s -k 11 x.vg
@@ -14,6 +14,21 @@ is $(vg map -s CTACTGACAGCAGAAGTTTGCTGTGAAGATTAAATTAGGTGATGCTTG x.vg -J | tr ','
 
 is $(vg map -s CTACTGACAGCAGAAGTTTGCTGTGAAGATTAAATTAGGTGATGCTTG x.vg -J | tr ',' '\n' | grep score | sed "s/}//g" | awk '{ print $2 }') 96 "alignment score is as expected"
 
+vg index -k 11 -T x.vg
+is $(vg map -T -s CTACTGACAGCAGAAGTTTGCTGTGAAGATTAAATTAGGTGATGCTTG x.vg -J | tr ',' '\n' | grep score | sed "s/}//g" | awk '{ print $2 }') 96 "alignment seeded from a memory-mapped kmer table"
+
+vg index -T x.vg 2>/dev/null
+is $? 1 "building a kmer table requires a kmer size"
+
+vg index -s -k 11 -w 8 -d x.mm.index x.vg
+is $(vg map -d x.mm.index -s CTACTGACAGCAGAAGTTTGCTGTGAAGATTAAATTAGGTGATGCTTG -J | tr ',' '\n' | grep score | sed "s/}//g" | awk '{ print $2 }') 96 "alignment seeded with minimizers"
+
+minimizer_count=$(vg index -D -d x.mm.index | grep '"+k+' | wc -l)
+kmer_count=$(vg index -D -d x.vg.index | grep '"+k+' | wc -l)
+is $(echo "$minimizer_count * 2 < $kmer_count" | bc) 1 "minimizers keep fewer than half of the kmers"
+
+is $(vg map -W 16 -s CTACTGACAGCAGAAGTTTGCTGTGAAGATTAAATTAGGTGATGCTTG x.vg -J | tr ',' '\n' | grep score | sed "s/}//g" | awk '{ print $2 }') 96 "banded alignment around the seed anchors"
+
 vg map -s CTACTGACAGCAGAAGTTTGCTGTGAAGATTAAATTAGGTGATGCTTG -d x.vg.index >/dev/null
 is $? 0 "vg map takes -d as input without a variant graph"
 
@@ -26,10 +41,14 @@ is $(vg map -s $seq x.vg | vg view -a - | jq -c '[.score, .sequence, .path.node_
    $(vg map -s $seq -J x.vg | jq -c '[.score, .sequence, .path.node_id]' | md5sum | awk '{print $1}') \
    "binary alignment format is equivalent to json version"
 
+is $(vg map -Z 0 -s $seq x.vg | vg view -a - | jq -c '[.score, .sequence, .path.node_id]' | md5sum | awk '{print $1}') \
+   $(vg map -s $seq -J x.vg | jq -c '[.score, .sequence, .path.node_id]' | md5sum | awk '{print $1}') \
+   "uncompressed alignment output can be read back"
+
 is $(vg map -b small/x.bam x.vg -J | jq .quality | grep null | wc -l) 0 "alignment from BAM correctly handles qualities"
 
 rm x.vg
-rm -rf x.vg.index
+rm -rf x.vg.index x.vg.index.kmers x.mm.index
 
 vg construct -r minigiab/q.fa -v minigiab/NA12878.chr22.tiny.giab.vcf.gz >giab.vg
 vg index -s -k 27 -e 7 giab.vg                                                   
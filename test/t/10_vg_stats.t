@@ -5,7 +5,7 @@ BASH_TAP_ROOT=../bash-tap
 
 PATH=..:$PATH # for vg
 
-plan tests 5
+plan tests 8
 
 vg construct -r 1mb1kgp/z.fa -v 1mb1kgp/z.vcf.gz >z.vg
 #is $? 0 "construction of a 1 megabase graph from the 1000 Genomes succeeds"
@@ -19,6 +19,8 @@ is $edges 115357 "vg stats reports the expected number of edges"
 graph_length=$(vg stats -l z.vg | tail -1 | cut -f 2)
 is $graph_length 1029257 "vg stats reports the expected graph length"
 
+is $(vg stats -z -l z.vg | md5sum | cut -f 1 -d\ ) $(vg stats -z -l -H z.vg | head -3 | md5sum | cut -f 1 -d\ ) "vg stats counts the same whether or not it builds a graph"
+
 subgraph_count=$(vg stats -s z.vg | wc -l)
 is $subgraph_count 1 "vg stats reports the correct number of subgraphs"
 
@@ -26,3 +28,9 @@ subgraph_length=$(vg stats -s z.vg | head -1 | cut -f 2)
 is $subgraph_length $graph_length  "vg stats reports the correct subgraph length"
 
 rm -f z.vg
+
+printf "S\t1\tCAAATAAG\nS\t2\tA\nL\t1\t+\t2\t+\t0M\nL\t2\t+\t3\t+\t0M\n" | vg view -v - >d.vg
+is $(vg stats -z d.vg | tail -1 | cut -f 2) 2 "vg stats counts the edges to nodes outside the graph"
+is $(vg stats -z -H d.vg | head -2 | tail -1 | cut -f 2) 2 "vg stats counts the edges to nodes outside the graph when it builds one"
+
+rm -f d.vg
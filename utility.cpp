@@ -1,5 +1,13 @@
 #include "utility.hpp"
 
+#include <algorithm>
+#include <iostream>
+#include <fstream>
+#include <queue>
+#include <atomic>
+#include <cstdio>
+#include <unistd.h>
+
 namespace vg {
 
 string reverse_complement(const string& seq) {
@@ -45,6 +53,42 @@ std::vector<std::string> split_delims(const std::string &s, const std::string& d
     return split_delims(s, delims, elems);
 }
 
+uint64_t minimizer_hash(const char* kmer, size_t length) {
+    // FNV-1a followed by a murmur3 finalizer to spread the bits
+    uint64_t h = 14695981039346656037ULL;
+    for (size_t i = 0; i < length; ++i) {
+        h ^= (unsigned char) kmer[i];
+        h *= 1099511628211ULL;
+    }
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+void mark_minimizers(const string& seq, int kmer_size, int window,
+                     vector<bool>& is_minimizer) {
+    int kmer_count = (int)seq.size() - kmer_size + 1;
+    is_minimizer.assign(max(kmer_count, 0), false);
+    if (kmer_count <= 0) return;
+    vector<uint64_t> hashes(kmer_count);
+    for (int i = 0; i < kmer_count; ++i) {
+        hashes[i] = minimizer_hash(seq.c_str() + i, kmer_size);
+    }
+    // a sequence with fewer kmers than the window is one window
+    int last = max(0, kmer_count - window);
+    for (int b = 0; b <= last; ++b) {
+        int e = min(b + window, kmer_count);
+        uint64_t m = hashes[b];
+        for (int i = b + 1; i < e; ++i) m = min(m, hashes[i]);
+        for (int i = b; i < e; ++i) {
+            if (hashes[i] == m) is_minimizer[i] = true;
+        }
+    }
+}
+
 const std::string sha1sum(const std::string& data) {
     SHA1 checksum;
     checksum.update(data);
@@ -55,4 +99,115 @@ const std::string sha1head(const std::string& data, size_t head) {
     return sha1sum(data).substr(0, head);
 }
 
+const std::string sha1sum(std::istream& in) {
+    SHA1 checksum;
+    checksum.update(in);
+    return checksum.final();
+}
+
+// runs are a series of entries, each key and value prefixed by its length
+static void write_run_entry(ostream& out, const string& key, const string& value) {
+    uint32_t size = key.size();
+    out.write((const char*) &size, sizeof(uint32_t));
+    out.write(key.data(), key.size());
+    size = value.size();
+    out.write((const char*) &size, sizeof(uint32_t));
+    out.write(value.data(), value.size());
+}
+
+static bool read_run_entry(istream& in, string& key, string& value) {
+    uint32_t size;
+    if (!in.read((char*) &size, sizeof(uint32_t))) return false;
+    key.resize(size);
+    in.read(&key[0], size);
+    in.read((char*) &size, sizeof(uint32_t));
+    value.resize(size);
+    in.read(&value[0], size);
+    if (!in) {
+        cerr << "error:[vg] sorted run is truncated" << endl;
+        exit(1);
+    }
+    return true;
+}
+
+// distinguishes the files of concurrent writers
+static atomic<uint64_t> sorted_run_count(0);
+
+static string sorted_run_name(const string& base_name) {
+    stringstream n;
+    n << base_name << ".run." << getpid() << "." << sorted_run_count++;
+    return n.str();
+}
+
+string write_sorted_run(const string& base_name, vector<pair<string, string> >& entries) {
+    std::sort(entries.begin(), entries.end());
+    string run = sorted_run_name(base_name);
+    ofstream out(run.c_str(), ios::binary);
+    for (auto& entry : entries) {
+        write_run_entry(out, entry.first, entry.second);
+    }
+    out.close();
+    if (!out) {
+        cerr << "error:[vg] could not write sorted run " << run << endl;
+        exit(1);
+    }
+    return run;
+}
+
+// a k-way merge of runs, all of which we can hold open at once
+static void merge_runs(const vector<string>& runs, function<void(const string&, const string&)> lambda) {
+    vector<ifstream*> ins;
+    vector<string> values(runs.size());
+    // the next key of each run, smallest first
+    priority_queue<pair<string, size_t>, vector<pair<string, size_t> >, greater<pair<string, size_t> > > heads;
+    for (size_t i = 0; i < runs.size(); ++i) {
+        ins.push_back(new ifstream(runs[i].c_str(), ios::binary));
+        string key;
+        if (read_run_entry(*ins[i], key, values[i])) {
+            heads.push(make_pair(key, i));
+        }
+    }
+    string last_key;
+    bool first = true;
+    while (!heads.empty()) {
+        string key = heads.top().first;
+        size_t i = heads.top().second;
+        heads.pop();
+        if (first || key != last_key) {
+            lambda(key, values[i]);
+            last_key = key;
+            first = false;
+        }
+        string next_key;
+        if (read_run_entry(*ins[i], next_key, values[i])) {
+            heads.push(make_pair(next_key, i));
+        }
+    }
+    for (size_t i = 0; i < runs.size(); ++i) {
+        delete ins[i];
+        std::remove(runs[i].c_str());
+    }
+}
+
+void merge_sorted_runs(const string& base_name, vector<string> runs,
+                       function<void(const string&, const string&)> lambda) {
+    // bound the number of files we hold open by merging groups of runs into longer ones
+    const size_t max_open_runs = 256;
+    while (runs.size() > max_open_runs) {
+        vector<string> merged;
+        for (size_t i = 0; i < runs.size(); i += max_open_runs) {
+            vector<string> group(runs.begin() + i, runs.begin() + min(i + max_open_runs, runs.size()));
+            string run = sorted_run_name(base_name);
+            ofstream out(run.c_str(), ios::binary);
+            merge_runs(group, [&out](const string& key, const string& value) {
+                    write_run_entry(out, key, value);
+                });
+            out.close();
+            merged.push_back(run);
+        }
+        runs = merged;
+    }
+    merge_runs(runs, lambda);
+}
+
 }
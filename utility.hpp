@@ -3,9 +3,12 @@
 
 #include <string>
 #include <vector>
+#include <functional>
+#include <utility>
 #include <sstream>
 #include <omp.h>
 #include <cstring>
+#include <cstdint>
 #include "sha1/sha1.hpp"
 
 namespace vg {
@@ -19,8 +22,24 @@ int get_thread_count(void);
 std::vector<std::string>& split_delims(const std::string &s, const std::string& delims, std::vector<std::string> &elems);
 std::vector<std::string> split_delims(const std::string &s, const std::string& delims);
 
+// deterministic hash used to order kmers when choosing minimizers
+uint64_t minimizer_hash(const char* kmer, size_t length);
+// flag the kmers of seq (by start position) that have the minimum hash in some window of
+// window consecutive kmers; ties flag every minimal kmer
+void mark_minimizers(const string& seq, int kmer_size, int window,
+                     vector<bool>& is_minimizer);
+
 const std::string sha1sum(const std::string& data);
 const std::string sha1head(const std::string& data, size_t head);
+// of everything remaining in the stream
+const std::string sha1sum(std::istream& in);
+
+// external sorting of key/value entries, for more of them than fit in memory
+// sorts the entries and writes them to a new run file named after base_name, returning its name
+string write_sorted_run(const string& base_name, vector<pair<string, string> >& entries);
+// merges the runs in key order, dropping entries with repeated keys, and removes them
+void merge_sorted_runs(const string& base_name, vector<string> runs,
+                       function<void(const string&, const string&)> lambda);
 
 }
 
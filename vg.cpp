@@ -6,8 +6,39 @@ namespace vg {
 using namespace std;
 
 
+// keeps the first of the elements with each key, in their original order
+template <typename T, typename K>
+static void keep_first_of_each(google::protobuf::RepeatedPtrField<T>* elements,
+                               function<K(const T&)> key) {
+    vector<pair<K, int> > keys;
+    keys.reserve(elements->size());
+    for (int i = 0; i < elements->size(); ++i) {
+        keys.push_back(make_pair(key(elements->Get(i)), i));
+    }
+    sort(keys.begin(), keys.end());
+    vector<bool> duplicate(elements->size(), false);
+    bool any = false;
+    for (size_t i = 1; i < keys.size(); ++i) {
+        if (keys[i].first == keys[i-1].first) {
+            duplicate[keys[i].second] = true;
+            any = true;
+        }
+    }
+    if (!any) return;
+    int kept = 0;
+    for (int i = 0; i < elements->size(); ++i) {
+        if (!duplicate[i]) {
+            if (i != kept) elements->SwapElements(i, kept);
+            ++kept;
+        }
+    }
+    while (elements->size() > kept) {
+        elements->RemoveLast();
+    }
+}
+
 // construct from a stream of protobufs
-VG::VG(istream& in, bool showp) {
+VG::VG(istream& in, bool showp, bool light) {
 
     // set up uninitialized values
     init();
@@ -17,14 +48,44 @@ VG::VG(istream& in, bool showp) {
         create_progress("loading graph", count);
     };
 
-    // the graph is read in chunks, which are attached to this graph
+    // the graph is read in chunks, which are decoded in parallel and attached to this graph in order
     uint64_t i = 0;
-    function<void(Graph&)> lambda = [this, &i](Graph& g) {
-        update_progress(++i);
-        extend(g);
+    function<void(vector<Graph>&)> lambda = [this, &i, light](vector<Graph>& chunks) {
+        if (!light) {
+            // size the indexes for everything the chunks might add, so they grow at most once
+            size_t node_count = graph.node_size();
+            size_t edge_count = graph.edge_size();
+            for (auto& g : chunks) {
+                node_count += g.node_size();
+                edge_count += g.edge_size();
+            }
+            resize_indexes(node_count, edge_count);
+        }
+        for (auto& g : chunks) {
+            update_progress(++i);
+            if (light) {
+                graph.mutable_node()->MergeFrom(g.node());
+                graph.mutable_edge()->MergeFrom(g.edge());
+                paths.append(g);
+            } else {
+                extend(g);
+            }
+        }
     };
 
-    stream::for_each(in, lambda, handle_count);
+    if (light) {
+        indexed = false;
+    }
+
+    stream::for_each_batch(in, lambda, handle_count);
+
+    if (light) {
+        // chunks repeat the edges between them, drop the copies as extend would have
+        keep_first_of_each<Node, int64_t>(graph.mutable_node(),
+                                          [](const Node& n) { return n.id(); });
+        keep_first_of_each<Edge, pair<int64_t, int64_t> >(graph.mutable_edge(),
+                                                           [](const Edge& e) { return make_pair(e.from(), e.to()); });
+    }
 
     // store paths in graph
     paths.to_graph(graph);
@@ -33,6 +94,26 @@ VG::VG(istream& in, bool showp) {
 
 }
 
+void VG::for_each_node_and_edge(istream& in,
+                                function<void(Node&)> node_lambda,
+                                function<void(Edge&)> edge_lambda) {
+    pair_hash_map<pair<int64_t, int64_t>, bool> seen_edges;
+    function<void(Graph&)> lambda = [&](Graph& g) {
+        for (int i = 0; i < g.node_size(); ++i) {
+            node_lambda(*g.mutable_node(i));
+        }
+        for (int i = 0; i < g.edge_size(); ++i) {
+            Edge* e = g.mutable_edge(i);
+            auto& seen = seen_edges[make_pair(e->from(), e->to())];
+            if (!seen) {
+                seen = true;
+                edge_lambda(*e);
+            }
+        }
+    };
+    stream::for_each(in, lambda);
+}
+
 void VG::serialize_to_ostream(ostream& out, int64_t chunk_size) {
 
     // save the number of the messages to be serialized into the output file
@@ -75,8 +156,26 @@ VG::VG(void) {
     init();
 }
 
+void VG::swap(VG& other) {
+    graph.Swap(&other.graph);
+    paths.swap(other.paths);
+    name.swap(other.name);
+    std::swap(current_id, other.current_id);
+    node_by_id.swap(other.node_by_id);
+    edge_by_id.swap(other.edge_by_id);
+    node_index.swap(other.node_index);
+    edge_index.swap(other.edge_index);
+    edges_from_to.swap(other.edges_from_to);
+    edges_to_from.swap(other.edges_to_from);
+    std::swap(indexed, other.indexed);
+    std::swap(gssw_aligner, other.gssw_aligner);
+    std::swap(alignable_root_id, other.alignable_root_id);
+}
+
 void VG::init(void) {
     gssw_aligner = NULL;
+    indexed = true;
+    alignable_root_id = 0;
     current_id = 1;
     show_progress = false;
     progress_message = "progress";
@@ -117,6 +216,7 @@ void VG::add_edges(vector<Edge>& edges) {
 }
 
 void VG::add_node(Node& node) {
+    ensure_indexes();
     if (!has_node(node)) {
         Node* new_node = graph.add_node(); // add it to the graph
         *new_node = node;
@@ -126,6 +226,7 @@ void VG::add_node(Node& node) {
 }
 
 void VG::add_edge(Edge& edge) {
+    ensure_indexes();
     if (!has_edge(edge)) {
         Edge* new_edge = graph.add_edge(); // add it to the graph
         *new_edge = edge;
@@ -143,6 +244,7 @@ int64_t VG::edge_count(void) {
 }
 
 int VG::in_degree(Node* node) {
+    ensure_indexes();
     auto in = edges_to_from.find(node->id());
     if (in == edges_to_from.end()) {
         return 0;
@@ -152,6 +254,7 @@ int VG::in_degree(Node* node) {
 }
 
 int VG::out_degree(Node* node) {
+    ensure_indexes();
     auto out = edges_from_to.find(node->id());
     if (out == edges_from_to.end()) {
         return 0;
@@ -161,6 +264,7 @@ int VG::out_degree(Node* node) {
 }
 
 void VG::edges_of_node(Node* node, vector<Edge*>& edges) {
+    ensure_indexes();
     hash_map<int64_t, vector<int64_t> >::iterator in = edges_to_from.find(node->id());
     if (in != edges_to_from.end()) {
         vector<int64_t>::iterator e = in->second.begin();
@@ -207,6 +311,7 @@ int64_t VG::total_length_of_nodes(void) {
 }
 
 void VG::build_indexes(void) {
+    indexed = true;
     for (int64_t i = 0; i < graph.node_size(); ++i) {
         Node* n = graph.mutable_node(i);
         node_index[n] = i;
@@ -242,12 +347,27 @@ void VG::clear_indexes_no_resize(void) {
 }
 
 void VG::resize_indexes(void) {
-    node_index.resize(graph.node_size());
-    node_by_id.resize(graph.node_size());
-    edge_by_id.resize(graph.edge_size());
-    edge_index.resize(graph.edge_size());
-    edges_from_to.resize(graph.edge_size());
-    edges_to_from.resize(graph.edge_size());
+    resize_indexes(graph.node_size(), graph.edge_size());
+}
+
+void VG::resize_indexes(size_t node_count, size_t edge_count) {
+    node_index.resize(node_count);
+    node_by_id.resize(node_count);
+    edge_by_id.resize(edge_count);
+    edge_index.resize(edge_count);
+    edges_from_to.resize(edge_count);
+    edges_to_from.resize(edge_count);
+}
+
+void VG::no_indexes(void) {
+    clear_indexes();
+    indexed = false;
+}
+
+void VG::yes_indexes(void) {
+    if (!indexed) {
+        rebuild_indexes();
+    }
 }
 
 void VG::rebuild_indexes(void) {
@@ -271,6 +391,7 @@ bool VG::has_node(Node& node) {
 }
 
 bool VG::has_node(int64_t id) {
+    ensure_indexes();
     return node_by_id.find(id) != node_by_id.end();
 }
 
@@ -283,6 +404,7 @@ bool VG::has_edge(Edge& edge) {
 }
 
 bool VG::has_edge(int64_t from, int64_t to) {
+    ensure_indexes();
     return edge_by_id.find(make_pair(from, to)) != edge_by_id.end();
 }
 
@@ -350,17 +472,12 @@ void VG::extend(VG& g) {
 }
 
 void VG::extend(Graph& graph) {
+    // add_node and add_edge skip what we already have
     for (int64_t i = 0; i < graph.node_size(); ++i) {
-        Node* n = graph.mutable_node(i);
-        if (!has_node(n)) {
-            add_node(*n);
-        }
+        add_node(*graph.mutable_node(i));
     }
     for (int64_t i = 0; i < graph.edge_size(); ++i) {
-        Edge* e = graph.mutable_edge(i);
-        if (!has_edge(e)) {
-            add_edge(*e);
-        }
+        add_edge(*graph.mutable_edge(i));
     }
     paths.append(graph);
 }
@@ -391,9 +508,9 @@ void VG::append(VG& g) {
         tails_ids.push_back((*n)->id());
     }
 
-    // add in the other graph
+    // move in the other graph
     // note that we don't use merge_union because we are ensured non-overlapping ids
-    merge(g);
+    absorb(g);
 
     /*
     cerr << "this graph size " << node_count() << " nodes " << edge_count() << " edges" << endl;
@@ -407,8 +524,6 @@ void VG::append(VG& g) {
         }
     }
 
-    // and join paths that are embedded in the graph, where path names are the same
-    paths.append(g.paths);
 }
 
 void VG::combine(VG& g) {
@@ -416,7 +531,30 @@ void VG::combine(VG& g) {
     //g.compact_ids();
     g.increment_node_ids(max_node_id());
     // now add it into the current graph, without connecting any nodes
-    extend(g);
+    absorb(g);
+}
+
+void VG::absorb(VG& g) {
+    ensure_indexes();
+    vector<Node*> nodes(g.graph.node_size());
+    g.graph.mutable_node()->ExtractSubrange(0, nodes.size(), nodes.data());
+    for (auto node : nodes) {
+        graph.mutable_node()->AddAllocated(node);
+        node_by_id[node->id()] = node;
+        node_index[node] = graph.node_size()-1;
+    }
+    vector<Edge*> edges(g.graph.edge_size());
+    g.graph.mutable_edge()->ExtractSubrange(0, edges.size(), edges.data());
+    for (auto edge : edges) {
+        graph.mutable_edge()->AddAllocated(edge);
+        set_edge(edge->from(), edge->to(), edge);
+        edge_index[edge] = graph.edge_size()-1;
+    }
+    // and join paths that are embedded in the graph, where path names are the same
+    paths.append(g.paths);
+    g.graph.Clear();
+    g.paths.clear();
+    g.clear_indexes();
 }
 
 int64_t VG::max_node_id(void) {
@@ -476,10 +614,12 @@ void VG::decrement_node_ids(int64_t decrement) {
 }
 
 void VG::swap_node_id(int64_t node_id, int64_t new_id) {
+    ensure_indexes();
     swap_node_id(node_by_id[node_id], new_id);
 }
 
 void VG::swap_node_id(Node* node, int64_t new_id) {
+    ensure_indexes();
 
     //cerr << "swapping " << node->id() << " for new id " << new_id << endl;
     int edge_n = edge_count();
@@ -1388,11 +1528,14 @@ VG::VG(vcflib::VariantCallFile& variantCallFile,
 void VG::sort(void) {
     deque<Node*> sorted_nodes;
     topological_sort(sorted_nodes);
-    deque<Node*>::iterator n = sorted_nodes.begin();
+    // take the nodes out of graph.node and put them back in order,
+    // they keep their addresses, so only node_index changes
+    vector<Node*> nodes(graph.node_size());
+    graph.mutable_node()->ExtractSubrange(0, nodes.size(), nodes.data());
     int i = 0;
-    for ( ; i < graph.node_size() && n != sorted_nodes.end();
-          ++i, ++n) {
-        swap_nodes(graph.mutable_node(i), *n);
+    for (deque<Node*>::iterator n = sorted_nodes.begin(); n != sorted_nodes.end(); ++n, ++i) {
+        graph.mutable_node()->AddAllocated(*n);
+        node_index[*n] = i;
     }
 }
 
@@ -1407,6 +1550,7 @@ size_t VG::length(void) {
 }
 
 void VG::swap_nodes(Node* a, Node* b) {
+    ensure_indexes();
     int aidx = node_index[a];
     int bidx = node_index[b];
     graph.mutable_node()->SwapElements(aidx, bidx);
@@ -1436,6 +1580,7 @@ Edge* VG::create_edge(int64_t from, int64_t to) {
 }
 
 Edge* VG::get_edge(int64_t from, int64_t to) {
+    ensure_indexes();
     pair_hash_map<pair<int64_t, int64_t>, Edge*>::iterator e = edge_by_id.find(make_pair(from, to));
     if (e != edge_by_id.end()) {
         return e->second;
@@ -1445,6 +1590,7 @@ Edge* VG::get_edge(int64_t from, int64_t to) {
 }
 
 void VG::set_edge(int64_t from, int64_t to, Edge* edge) {
+    ensure_indexes();
     if (!has_edge(edge)) {
         edge_by_id[make_pair(from, to)] = edge;
         edges_from_to[from].push_back(to);
@@ -1473,6 +1619,7 @@ void VG::for_each_edge(function<void(Edge*)> lambda) {
 }
 
 vector<int64_t>& VG::edges_from(int64_t id) {
+    ensure_indexes();
     hash_map<int64_t, vector<int64_t> >::iterator e = edges_from_to.find(id);
     if (e == edges_from_to.end()) {
         return empty_ids;
@@ -1482,6 +1629,7 @@ vector<int64_t>& VG::edges_from(int64_t id) {
 }
 
 vector<int64_t>& VG::edges_to(int64_t id) {
+    ensure_indexes();
     hash_map<int64_t, vector<int64_t> >::iterator e = edges_to_from.find(id);
     if (e == edges_to_from.end()) {
         return empty_ids;
@@ -1513,6 +1661,7 @@ void VG::destroy_edge(int64_t from, int64_t to) {
 }
 
 void VG::destroy_edge(Edge* edge) {
+    ensure_indexes();
     //cerr << "destroying edge " << edge->from() << "->" << edge->to() << endl;
 
     // noop on NULL pointer or non-existent edge
@@ -1582,6 +1731,7 @@ void VG::destroy_edge(Edge* edge) {
 }
 
 Node* VG::get_node(int64_t id) {
+    ensure_indexes();
     hash_map<int64_t, Node*>::iterator n = node_by_id.find(id);
     if (n != node_by_id.end()) {
         return n->second;
@@ -1648,11 +1798,49 @@ void VG::node_context(Node* node, VG& g) {
     }
 }
 
+void VG::offset_band(const map<int64_t, int32_t>& anchors,
+                     int32_t min_offset,
+                     int32_t max_offset,
+                     VG& band) {
+    // the first offset we reach a node at wins
+    map<int64_t, int32_t> offsets;
+    deque<pair<int64_t, int32_t> > todo;
+    for (auto& a : anchors) {
+        if (has_node(a.first)) todo.push_back(a);
+    }
+    while (!todo.empty()) {
+        int64_t id = todo.front().first;
+        int32_t offset = todo.front().second;
+        todo.pop_front();
+        if (offsets.count(id)) continue;
+        Node* node = get_node(id);
+        int32_t length = node->sequence().size();
+        if (offset > max_offset || offset + length < min_offset) continue;
+        offsets[id] = offset;
+        band.add_node(*node);
+        for (auto& next : edges_from(id)) {
+            todo.push_back(make_pair(next, offset + length));
+        }
+        for (auto& prev : edges_to(id)) {
+            todo.push_back(make_pair(prev, offset - (int32_t)get_node(prev)->sequence().size()));
+        }
+    }
+    // and the edges between the nodes we kept
+    for (auto& o : offsets) {
+        for (auto& next : edges_from(o.first)) {
+            if (offsets.count(next)) {
+                band.add_edge(*get_edge(o.first, next));
+            }
+        }
+    }
+}
+
 void VG::destroy_node(int64_t id) {
     destroy_node(get_node(id));
 }
 
 void VG::destroy_node(Node* node) {
+    ensure_indexes();
     //if (!is_valid()) cerr << "graph is invalid before destroy_node" << endl;
     //cerr << "destroying node " << node->id() << endl;
     // noop on NULL/nonexistent node
@@ -2025,6 +2213,8 @@ void VG::for_each_kpath(int k, int edge_max,
 
 void VG::for_each_kpath_parallel(int k, int edge_max,
                                  function<void(Node*,list<Node*>&)> lambda) {
+    // the threads would race to build the indexes of a light graph
+    ensure_indexes();
     auto by_node = [k, edge_max, &lambda, this](Node* node) {
         for_each_kpath_of_node(node, k, edge_max, lambda);
     };
@@ -2033,6 +2223,7 @@ void VG::for_each_kpath_parallel(int k, int edge_max,
 
 void VG::for_each_kpath_parallel(int k, int edge_max,
                                  function<void(Node*,Path&)> lambda) {
+    ensure_indexes();
     auto by_node = [k, edge_max, &lambda, this](Node* node) {
         for_each_kpath_of_node(node, k, edge_max, lambda);
     };
@@ -2130,6 +2321,7 @@ string VG::path_string(const list<Node*>& nodes) {
 }
 
 string VG::path_string(Path& path) {
+    ensure_indexes();
     string seq;
     for (int i = 0; i < path.mapping_size(); ++i) {
         Mapping* m = path.mutable_mapping(i);
@@ -2338,6 +2530,7 @@ void VG::node_starts_in_path(const list<Node*>& path,
 }
 
 void VG::kpaths_of_node(int64_t node_id, vector<Path>& paths, int length, int edge_max) {
+    ensure_indexes();
     hash_map<int64_t, Node*>::iterator n = node_by_id.find(node_id);
     if (n != node_by_id.end()) {
         Node* node = n->second;
@@ -2346,6 +2539,7 @@ void VG::kpaths_of_node(int64_t node_id, vector<Path>& paths, int length, int ed
 }
 
 string VG::path_sequence(const Path& path) {
+    ensure_indexes();
     string sequence;
     for (int i = 0; i < path.mapping_size(); ++i) {
         sequence.append(node_by_id[path.mapping(i).node_id()]->sequence());
@@ -2382,6 +2576,7 @@ string VG::random_read(int length, mt19937& rng, int64_t min_id, int64_t max_id,
 }
 
 bool VG::is_valid(void) {
+    ensure_indexes();
 
     if (node_by_id.size() != graph.node_size()) {
         cerr << "graph invalid: node count is not equal to that found in node by-id index" << endl;
@@ -2571,9 +2766,23 @@ void VG::to_gfa(ostream& out) {
     }
 }
 
+void VG::create_alignable_graph(void) {
+    destroy_alignable_graph();
+    // to be completely aligned, the graph's head nodes need to be fully-connected to a common root
+    Node* root = join_heads();
+    alignable_root_id = root->id();
+    sort();
+    gssw_aligner = new GSSWAligner(graph);
+}
+
 void VG::destroy_alignable_graph(void) {
     if (gssw_aligner != NULL) {
         delete gssw_aligner;
+        gssw_aligner = NULL;
+    }
+    if (alignable_root_id) {
+        destroy_node(alignable_root_id);
+        alignable_root_id = 0;
     }
 }
 
@@ -2624,16 +2833,16 @@ void VG::add_start_and_end_markers(int length, char start_char, char end_char) {
 
 Alignment& VG::align(Alignment& alignment) {
 
-    // to be completely aligned, the graph's head nodes need to be fully-connected to a common root
-    Node* root = join_heads();
-    sort();
+    bool temporary = (gssw_aligner == NULL);
+    if (temporary) {
+        create_alignable_graph();
+    }
 
-    gssw_aligner = new GSSWAligner(graph);
     gssw_aligner->align(alignment);
-    delete gssw_aligner;
-    gssw_aligner = NULL;
 
-    destroy_node(root);
+    if (temporary) {
+        destroy_alignable_graph();
+    }
 
     return alignment;
 }
@@ -2648,16 +2857,18 @@ void VG::for_each_kmer_parallel(int kmer_size,
                                 int edge_max,
                                 function<void(string&, Node*, int, list<Node*>&, VG&)> lambda,
                                 int stride,
-                                bool allow_dups) {
-    _for_each_kmer(kmer_size, edge_max, lambda, true, stride, allow_dups);
+                                bool allow_dups,
+                                int minimizer_window) {
+    _for_each_kmer(kmer_size, edge_max, lambda, true, stride, allow_dups, minimizer_window);
 }
 
 void VG::for_each_kmer(int kmer_size,
                        int edge_max,
                        function<void(string&, Node*, int, list<Node*>&, VG&)> lambda,
                        int stride,
-                       bool allow_dups) {
-    _for_each_kmer(kmer_size, edge_max, lambda, false, stride, allow_dups);
+                       bool allow_dups,
+                       int minimizer_window) {
+    _for_each_kmer(kmer_size, edge_max, lambda, false, stride, allow_dups, minimizer_window);
 }
 
 void VG::_for_each_kmer(int kmer_size,
@@ -2665,7 +2876,8 @@ void VG::_for_each_kmer(int kmer_size,
                         function<void(string&, Node*, int, list<Node*>&, VG&)> lambda,
                         bool parallel,
                         int stride,
-                        bool allow_dups) {
+                        bool allow_dups,
+                        int minimizer_window) {
 
     // use an LRU cache to clean up duplicates over the last 1mb
     // use one per thread so as to avoid contention
@@ -2696,6 +2908,7 @@ void VG::_for_each_kmer(int kmer_size,
                         kmer_size,
                         stride,
                         allow_dups,
+                        minimizer_window,
                         &lru,
                         &make_cache_key](Node* node, list<Node*>& path) {
 
@@ -2713,9 +2926,18 @@ void VG::_for_each_kmer(int kmer_size,
         // by first getting the sequence
         string seq = path_string(path);
 
+        // the kpath holds every full window around the kmers of the node, and only
+        // full windows are marked, as they are for reads
+        vector<bool> is_minimizer;
+        if (minimizer_window) {
+            mark_minimizers(seq, kmer_size, minimizer_window, is_minimizer);
+        }
+
         // and then stepping across the path, finding the kmers, and then implied node overlaps
         for (int i = 0; i <= seq.size() - kmer_size; i+=stride) {
 
+            if (minimizer_window && !is_minimizer[i]) continue;
+
             // get the kmer
             string kmer = seq.substr(i, kmer_size);
             // record when we get a kmer match
@@ -2754,10 +2976,18 @@ void VG::_for_each_kmer(int kmer_size,
         }
     };
 
+    // a window of minimizer_window kmers reaches minimizer_window - 1 bases further
+    // than a kmer, so walk that much further out from each node
+    int kpath_length = kmer_size;
+    int kpath_edge_max = edge_max;
+    if (minimizer_window) {
+        kpath_length += minimizer_window - 1;
+        kpath_edge_max += minimizer_window - 1;
+    }
     if (parallel) {
-        for_each_kpath_parallel(kmer_size, edge_max, handle_path);
+        for_each_kpath_parallel(kpath_length, kpath_edge_max, handle_path);
     } else {
-        for_each_kpath(kmer_size, edge_max, handle_path);
+        for_each_kpath(kpath_length, kpath_edge_max, handle_path);
     }
 
 }
@@ -2872,11 +3102,12 @@ void VG::disjoint_subgraphs(list<VG>& subgraphs) {
         set<Node*>& nodes = g->second;
         set<Edge*> edges;
         edges_of_nodes(nodes, edges);
-        subgraphs.push_back(VG(nodes, edges));
+        subgraphs.emplace_back(nodes, edges);
     }
 }
 
 void VG::head_nodes(vector<Node*>& nodes) {
+    ensure_indexes();
     for (int i = 0; i < graph.node_size(); ++i) {
         Node* n = graph.mutable_node(i);
         if (edges_to_from.find(n->id()) == edges_to_from.end()) {
@@ -2892,6 +3123,7 @@ vector<Node*> VG::head_nodes(void) {
 }
 
 void VG::tail_nodes(vector<Node*>& nodes) {
+    ensure_indexes();
     for (int i = 0; i < graph.node_size(); ++i) {
         Node* n = graph.mutable_node(i);
         if (edges_from_to.find(n->id()) == edges_from_to.end()) {
@@ -2939,81 +3171,73 @@ if graph has edges then
     return error (graph has at least one cycle)
 else 
     return L (a topologically sorted order)
+
+We don't remove edges, but count down the incoming edges of each node,
+and S is a min-heap on node id.
     */
 
 void VG::topological_sort(deque<Node*>& l) {
     //assert(is_valid());
-
-    // using a map instead of a set ensures a stable sort across different systems
-    map<int64_t, Node*> s;
-    vector<Node*> heads;
-    head_nodes(heads);
-    for (vector<Node*>::iterator n = heads.begin(); n != heads.end(); ++n) {
-        s[(*n)->id()] = *n;
+    ensure_indexes();
+
+    // rather than removing edges from the graph, we count the incoming edges of
+    // each node, by its index in graph.node, which we haven't yet passed
+    int64_t node_count = graph.node_size();
+    vector<int> in_degree(node_count);
+    // taking the lowest id first ensures a stable sort across different systems
+    priority_queue<pair<int64_t, int>, vector<pair<int64_t, int> >, greater<pair<int64_t, int> > > s;
+    for (int i = 0; i < node_count; ++i) {
+        Node* n = graph.mutable_node(i);
+        in_degree[i] = edges_to(n->id()).size();
+        if (in_degree[i] == 0) {
+            s.push(make_pair(n->id(), i));
+        }
     }
 
     // check that we have heads of the graph
-    if (heads.empty() && graph.node_size() > 0) {
+    if (s.empty() && node_count > 0) {
         cerr << "error:[VG::topological_sort] No heads of graph given, but graph not empty. "
              << "In-memory indexes of nodes and edges may be out of sync." << endl;
         exit(1);
     }
-    int64_t seen = heads.size();
+    int64_t seen = s.size();
 
     while (!s.empty()) {
-        Node* n = s.begin()->second;
-        s.erase(n->id());
+        Node* n = graph.mutable_node(s.top().second);
+        s.pop();
         l.push_back(n);
-        vector<int64_t>& from = edges_from(n);
-        vector<int64_t> to_erase;
+        vector<int64_t>& from = edges_from(n->id());
         for (vector<int64_t>::iterator f = from.begin(); f != from.end(); ++f) {
-            Node* m = node_by_id[*f];
             ++seen;
-            to_erase.push_back(m->id());
-            remove_edge_tfi(n->id(), m->id());
-            if (edges_to(m->id()).empty()) {
-                s[m->id()] = m;
+            auto m = node_by_id.find(*f);
+            if (m == node_by_id.end()) continue;
+            int j = node_index[m->second];
+            if (--in_degree[j] == 0) {
+                s.push(make_pair(*f, j));
             }
         }
         update_progress(seen);
-        for (vector<int64_t>::iterator t = to_erase.begin(); t != to_erase.end(); ++t) {
-            remove_edge_fti(n->id(), *t);
-        }
     }
+
     // if we have a cycle, signal an error, as we are not guaranteed an order
-    for (hash_map<int64_t, vector<int64_t> >::iterator f = edges_from_to.begin();
-         f != edges_from_to.end(); ++f) {
-        if (!f->second.empty()) {
-            cerr << "error:[VG::topological_sort] graph has a cycle from " << f->first
-                 << " to " << f->second.front() << endl
-                 << "thread " << omp_get_thread_num() << endl;
-#pragma omp critical
-            {
-                std::ofstream out("fail.vg");
-                serialize_to_ostream(out);
-                out.close();
-                exit(1);
+    if ((int64_t) l.size() < node_count) {
+        for (int i = 0; i < node_count; ++i) {
+            if (in_degree[i] > 0) {
+                int64_t id = graph.node(i).id();
+                cerr << "error:[VG::topological_sort] graph has a cycle to " << id
+                     << " from " << edges_to(id).front() << endl
+                     << "thread " << omp_get_thread_num() << endl;
+                break;
             }
         }
-    }
-    for (hash_map<int64_t, vector<int64_t> >::iterator t = edges_to_from.begin();
-         t != edges_to_from.end(); ++t) {
-        if (!t->second.empty()) {
-            cerr << "error:[VG::topological_sort] graph has a cycle to " << t->first
-                 << " to " << t->second.front() << endl
-                 << "thread " << omp_get_thread_num() << endl;
 #pragma omp critical
-            {
-                std::ofstream out("fail.vg");
-                serialize_to_ostream(out);
-                out.close();
-                exit(1);
-            }
+        {
+            std::ofstream out("fail.vg");
+            serialize_to_ostream(out);
+            out.close();
+            exit(1);
         }
     }
-    // we have destroyed the graph's index to ensure its order
-    // rebuild the indexes
-    rebuild_indexes();
 }
 
 } // end namespace
@@ -5,6 +5,7 @@
 #include <set>
 #include <string>
 #include <deque>
+#include <queue>
 #include <list>
 #include <omp.h>
 #include <unistd.h>
@@ -100,7 +101,8 @@ public:
     VG(void);
 
     // construct from protobufs
-    VG(istream& in, bool showp = false);
+    // a light graph only merges the chunks, and builds its indexes on first use
+    VG(istream& in, bool showp = false, bool light = false);
 
     // construct from sets of nodes and edges (e.g. subgraph of another graph)
     VG(set<Node*>& nodes, set<Edge*>& edges);
@@ -147,13 +149,10 @@ public:
     }
 
     // move constructor
+    // the protobuf graph, paths and indexes are swapped, leaving other empty
     VG(VG&& other) noexcept {
         init();
-        graph = other.graph;
-        paths = other.paths;
-        other.graph.Clear();
-        rebuild_indexes();
-        // should copy over indexes
+        swap(other);
     }
 
     // copy assignment operator
@@ -165,25 +164,40 @@ public:
 
     // move assignment operator
     VG& operator=(VG&& other) noexcept {
-        std::swap(graph, other.graph);
-        rebuild_indexes();
+        swap(other);
         return *this;
     }
 
-    // todo
-    // set vg up to not build indexes
-    // providing very light runtime
-    // this would disable a ton of functions
-    // and change the deserialization semantics
-    //
-    //void no_indexes(void);
-    //void yes_indexes(void);
+    // exchanges the contents of the graphs in O(1)
+    // nodes and edges keep their addresses, so the indexes stay valid
+    void swap(VG& other);
+
+    // the node and edge indexes can be dropped, leaving only the protobuf graph,
+    // which is all that methods which just walk graph.node and graph.edge need
+    // the accessors (has_node, get_node, edges_from, head_nodes, add_node, ...)
+    // rebuild them on first use, code using the index members directly must call yes_indexes
+    // ensure_indexes takes no lock, so a light graph must have its indexes built before it
+    // reaches any accessor from several threads (e.g. for_each_kmer_parallel); the parallel
+    // kpath and kmer walks build them before they start their threads
+    bool indexed;
+    void no_indexes(void);
+    void yes_indexes(void);
+    void ensure_indexes(void) { if (!indexed) yes_indexes(); }
+
+    // calls the lambdas on each node and edge of a .vg stream, one chunk at a time,
+    // without building a graph; edges are visited once, although chunks repeat
+    // those between them, so the (from, to) pairs of the edges seen are kept
+    static void for_each_node_and_edge(istream& in,
+                                       function<void(Node&)> node_lambda,
+                                       function<void(Edge&)> edge_lambda);
 
     void build_indexes(void);
     void index_paths(void);
     void clear_indexes(void);
     void clear_indexes_no_resize(void);
     void resize_indexes(void);
+    // makes room in the indexes for this many nodes and edges
+    void resize_indexes(size_t node_count, size_t edge_count);
     void rebuild_indexes(void);
 
     // literally merge protobufs
@@ -217,13 +231,17 @@ public:
     void extend(Graph& graph);
 
     // modify ids of the second graph to ensure we don't have conflicts
-    // then attach tails of this graph to the heads of the other, and extend(g)
+    // then attach tails of this graph to the heads of the other, and absorb(g)
     void append(VG& g);
 
     // don't append or join the nodes in the graphs
-    // just ensure that ids are unique, then apply extend
+    // just ensure that ids are unique, then absorb g
     void combine(VG& g);
 
+    // moves the nodes, edges and paths of g into this graph without copying them
+    // indexing only what is new, the ids must not overlap, and g is left empty
+    void absorb(VG& g);
+
     // edit the graph to include the path
     void include(const Path& path);
     // or a set of mappings against one node
@@ -250,6 +268,12 @@ public:
     Node* create_node(string seq);
     Node* get_node(int64_t id);
     void node_context(Node* node, VG& g);
+    // walks out from anchor nodes, given the estimated offsets of their starts in a sequence,
+    // and collects into band the nodes whose estimated extent overlaps [min_offset, max_offset]
+    void offset_band(const map<int64_t, int32_t>& anchors,
+                     int32_t min_offset,
+                     int32_t max_offset,
+                     VG& band);
     void destroy_node(Node* node);
     void destroy_node(int64_t id);
     bool has_node(int64_t id);
@@ -307,12 +331,18 @@ public:
     void topological_sort(deque<Node*>& l);
     void swap_nodes(Node* a, Node* b);
 
+    // if an alignable graph has been created, it is reused
+    // otherwise one is built and torn down for this alignment
     Alignment& align(Alignment& alignment);
     Alignment align(string& sequence);
-    //Alignment& align(Alignment& alignment);
+    // joins the heads to a root node, sorts, and builds the gssw graph once
+    // so many sequences can be aligned against it
+    // the graph must not be modified until destroy_alignable_graph is called
+    void create_alignable_graph(void);
     void destroy_alignable_graph(void);
 
     GSSWAligner* gssw_aligner;
+    int64_t alignable_root_id;
 
     // returns all node-crossing paths with up to length across node boundaries
     void for_each_kpath(int k, int edge_max, function<void(Node*,list<Node*>&)> lambda);
@@ -352,16 +382,20 @@ public:
                              map<Node*, int>& node_start);
 
     // kmers
+    // if minimizer_window is set, only kmers which are (window,kmer_size)-minimizers
+    // of some walk through the graph are reported
     void for_each_kmer_parallel(int kmer_size,
                                 int edge_max,
                                 function<void(string&, Node*, int, list<Node*>&, VG&)> lambda,
                                 int stride = 1,
-                                bool allow_dups = false);
+                                bool allow_dups = false,
+                                int minimizer_window = 0);
     void for_each_kmer(int kmer_size,
                        int edge_max,
                        function<void(string&, Node*, int, list<Node*>&, VG&)> lambda,
                        int stride = 1,
-                       bool allow_dups = false);
+                       bool allow_dups = false,
+                       int minimizer_window = 0);
     // for gcsa2
     void kmer_context(string& kmer,
                       list<Node*>& path,
@@ -377,7 +411,8 @@ private:
                         function<void(string&, Node*, int, list<Node*>&, VG&)> lambda,
                         bool parallel,
                         int stride,
-                        bool allow_dups);
+                        bool allow_dups,
+                        int minimizer_window);
 
 
 public:
@@ -44,6 +44,44 @@ void VGset::for_each(std::function<void(VG*)> lambda) {
     }
 }
 
+string VGset::fingerprint(const string& name) {
+    if (name == "-") return "";
+    auto f = fingerprints.find(name);
+    if (f != fingerprints.end()) return f->second;
+    ifstream in(name.c_str(), ios::binary);
+    string sum = sha1sum(in);
+    fingerprints[name] = sum;
+    return sum;
+}
+
+void VGset::skip_indexed(Index& index, const string& stage) {
+    vector<string> unindexed;
+    for (auto& name : filenames) {
+        string sum = fingerprint(name);
+        string indexed = sum.empty() ? "" : index.indexed_input(stage, name);
+        if (indexed.empty()) {
+            unindexed.push_back(name);
+        } else if (indexed != sum) {
+            // its old entries can't be told apart from the others, so we can't replace them
+            cerr << "error:[vg::VGset] " << name << " has changed since it was indexed (" << stage << "), "
+                 << "rebuild the index to include it" << endl;
+            exit(1);
+        } else if (show_progress) {
+            cerr << "skipping " << name << ", already indexed (" << stage << ")" << endl;
+        }
+    }
+    filenames = unindexed;
+}
+
+void VGset::remember_indexed(Index& index, const string& stage) {
+    for (auto& name : filenames) {
+        string sum = fingerprint(name);
+        if (!sum.empty()) {
+            index.remember_input(stage, name, sum);
+        }
+    }
+}
+
 int64_t VGset::merge_id_space(void) {
     int64_t max_node_id = 0;
     int64_t max_path_id = 0;
@@ -70,11 +108,30 @@ void VGset::store_paths_in_index(Index& index) {
 }
 
 // stores kmers of size kmer_size with stride over paths in graphs in the index
-void VGset::index_kmers(Index& index, int kmer_size, int edge_max, int stride) {
+void VGset::index_kmers(Index& index, int kmer_size, int edge_max, int stride, int minimizer_window,
+                        bool with_stored_context) {
 
-    // create a vector of output files
-    // as many as there are threads
-    for_each([&index, kmer_size, edge_max, stride, this](VG* g) {
+    // each thread sorts its buffer of entries and spills it to a run file when it fills
+    // the runs of all the graphs are merged into sst files which are ingested into the index
+    vector<string> runs;
+
+    for_each([&index, &runs, kmer_size, edge_max, stride, minimizer_window, with_stored_context, this](VG* g) {
+
+        if (with_stored_context) {
+            // the stored edges of our nodes lead to graphs indexed before
+            vector<Edge> edges;
+            g->for_each_node([&index, &edges](Node* n) {
+                    index.get_edges_of(n->id(), edges);
+                });
+            for (auto& edge : edges) {
+                g->add_edge(edge);
+            }
+            // walk out edge_max steps over the stored graph, then pull in the nodes
+            // at the far ends of the last step's edges
+            index.expand_context(*g, edge_max);
+            index.get_connected_nodes(*g);
+            g->remove_orphan_edges();
+        }
 
         int thread_count;
 #pragma omp parallel
@@ -84,58 +141,122 @@ void VGset::index_kmers(Index& index, int kmer_size, int edge_max, int stride) {
         }
 
         // these are indexed by thread
-        vector<vector<KmerMatch> > buffer;
-        for (int i = 0; i < thread_count; ++i) {
-            buffer.emplace_back();
-        }
+        vector<vector<pair<string, string> > > buffer(thread_count);
         // how many kmer entries to hold onto
-        uint64_t buffer_max_size = 100000; // 100k
-
-        // this may need a guard
-        auto write_buffer = [&index](int tid, vector<KmerMatch>& buf) {
-            rocksdb::WriteBatch batch;
-            function<void(KmerMatch&)> keep_kmer = [&index, &batch](KmerMatch& k) {
-                index.batch_kmer(k.sequence(), k.node_id(), k.position(), batch);
-            };
-            std::for_each(buf.begin(), buf.end(), keep_kmer);
-            rocksdb::Status s = index.db->Write(rocksdb::WriteOptions(), &batch);
+        uint64_t buffer_max_size = 1000000; // 1M
+
+        auto write_buffer = [&index, &runs](vector<pair<string, string> >& buf) {
+            if (buf.empty()) return;
+            string run = index.write_sorted_run(buf);
+#pragma omp critical (kmer_runs)
+            runs.push_back(run);
+            buf.clear();
         };
 
-        auto cache_kmer = [&buffer, &buffer_max_size, &write_buffer,
+        auto cache_kmer = [&index, &buffer, &buffer_max_size, &write_buffer,
                            this](string& kmer, Node* n, int p, list<Node*>& path, VG& graph) {
             if (allATGC(kmer)) {
                 int tid = omp_get_thread_num();
                 // note that we don't need to guard this
                 // each thread has its own buffer!
                 auto& buf = buffer[tid];
-                KmerMatch k;
-                k.set_sequence(kmer); k.set_node_id(n->id()); k.set_position(p);
-                buf.push_back(k);
+                string data(sizeof(int32_t), '\0');
+                memcpy((char*) data.c_str(), &p, sizeof(int32_t));
+                buf.push_back(make_pair(index.key_for_kmer(kmer, n->id()), data));
                 if (buf.size() > buffer_max_size) {
-                    write_buffer(tid, buf);
-                    buf.clear();
+                    write_buffer(buf);
                 }
             }
         };
 
         g->create_progress("indexing kmers of " + g->name, buffer.size());
-        g->for_each_kmer_parallel(kmer_size, edge_max, cache_kmer, stride);
+        g->for_each_kmer_parallel(kmer_size, edge_max, cache_kmer, stride, false, minimizer_window);
         g->destroy_progress();
 
         g->create_progress("flushing kmer buffers " + g->name, g->size());
         int tid = 0;
 #pragma omp parallel for schedule(dynamic)
         for (int i = 0; i < buffer.size(); ++i) {
-            auto& buf = buffer[i];
-            write_buffer(i, buf);
+            write_buffer(buffer[i]);
             g->update_progress(tid);
         }
         buffer.clear();
         g->destroy_progress();
     });
 
+    if (show_progress) {
+        cerr << "merging " << runs.size() << " sorted runs of kmers into the index" << endl;
+    }
+    index.ingest_sorted_runs(runs, 'k');
+
     index.remember_kmer_size(kmer_size);
+    if (minimizer_window) {
+        index.remember_minimizer_window(minimizer_window);
+    }
+
+}
+
+void VGset::write_kmer_table(const string& filename, int kmer_size, int edge_max, int stride,
+                             int minimizer_window) {
 
+    int thread_count;
+#pragma omp parallel
+    {
+#pragma omp master
+        thread_count = omp_get_num_threads();
+    }
+
+    vector<string> runs;
+
+    for_each([&runs, &filename, thread_count, kmer_size, edge_max, stride, minimizer_window, this](VG* g) {
+
+        // these are indexed by thread, and spilled as sorted runs beside the table when full
+        vector<vector<pair<string, string> > > buffer(thread_count);
+        // how many kmer entries to hold onto
+        uint64_t buffer_max_size = 1000000; // 1M
+
+        auto write_buffer = [&filename, &runs](vector<pair<string, string> >& buf) {
+            if (buf.empty()) return;
+            string run = write_sorted_run(filename, buf);
+#pragma omp critical (kmer_table_runs)
+            runs.push_back(run);
+            buf.clear();
+        };
+
+        auto cache_kmer = [&buffer, &buffer_max_size, &write_buffer](string& kmer, Node* n, int p,
+                                                                    list<Node*>& path, VG& graph) {
+            KmerTableEntry e;
+            if (KmerTable::pack_kmer(kmer, e.kmer)) {
+                e.node_id = n->id();
+                e.position = p;
+                auto& buf = buffer[omp_get_thread_num()];
+                buf.push_back(make_pair(KmerTable::entry_key(e), string()));
+                if (buf.size() > buffer_max_size) {
+                    write_buffer(buf);
+                }
+            }
+        };
+
+        g->show_progress = show_progress;
+        g->progress_message = "collecting kmers of " + g->name;
+        g->for_each_kmer_parallel(kmer_size, edge_max, cache_kmer, stride, false, minimizer_window);
+
+#pragma omp parallel for schedule(dynamic)
+        for (int i = 0; i < buffer.size(); ++i) {
+            write_buffer(buffer[i]);
+        }
+    });
+
+    if (show_progress) {
+        cerr << "merging " << runs.size() << " sorted runs of kmers into " << filename << endl;
+    }
+    // the merge drops repeated keys, so the entries come out sorted and unique
+    KmerTable::write_sorted(filename, kmer_size,
+                            [&runs, &filename](function<void(const KmerTableEntry&)> lambda) {
+            merge_sorted_runs(filename, runs, [&lambda](const string& key, const string& value) {
+                    lambda(KmerTable::parse_entry_key(key));
+                });
+        });
 }
 
 void VGset::for_each_kmer_parallel(function<void(string&, Node*, int, list<Node*>&, VG&)>& lambda,
@@ -5,6 +5,7 @@
 #include <stdlib.h>
 #include "vg.hpp"
 #include "index.hpp"
+#include "kmer_table.hpp"
 #include "hash_map.hpp"
 
 namespace vg {
@@ -27,6 +28,15 @@ public:
     void transform(std::function<void(VG*)> lambda);
     void for_each(std::function<void(VG*)> lambda);
 
+    // for incremental indexing, stage names what is done with the inputs (e.g. "graph")
+    // drops the inputs which the index already holds, as they are now
+    // exits with an error if an input has changed since it was indexed
+    void skip_indexed(Index& index, const string& stage);
+    // records the inputs in the index
+    void remember_indexed(Index& index, const string& stage);
+    // sha1 of the file's contents, empty for stdin
+    string fingerprint(const string& name);
+
     // merges the id space of a set of graphs on-disk
     // necessary when storing many graphs in the same index
     int64_t merge_id_space(void);
@@ -36,12 +46,23 @@ public:
     void store_paths_in_index(Index& index);
 
     // stores kmers of size kmer_size with stride over paths in graphs in the index
-    void index_kmers(Index& index, int kmer_size, int edge_max, int stride = 1);
+    // if minimizer_window is set, only the (minimizer_window,kmer_size)-minimizers are stored
+    // if with_stored_context is set, the graphs are extended with the nodes already in the index within
+    // edge_max edges of them, so the kmers which span into those are indexed too
+    void index_kmers(Index& index, int kmer_size, int edge_max, int stride = 1, int minimizer_window = 0,
+                     bool with_stored_context = false);
+    // writes the same kmers into a flat table that can be memory-mapped by the mapper
+    void write_kmer_table(const string& filename, int kmer_size, int edge_max, int stride = 1,
+                          int minimizer_window = 0);
     void for_each_kmer_parallel(function<void(string&, Node*, int, list<Node*>&, VG&)>& lambda,
                                 int kmer_size, int edge_max, int stride, bool allow_dups);
     void write_gcsa_out(ostream& out, int kmer_size, int edge_max, int stride, bool allow_dups = true);
 
     bool show_progress;
+
+private:
+
+    map<string, string> fingerprints;
     
 };
 